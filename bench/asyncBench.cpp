@@ -0,0 +1,57 @@
+// Throughput and accuracy of Hogwild-style train_async against the sequential per-sample train_epoch
+// Usage: async_bench [epochs] [dataset_copies] [max_threads]
+// The training split is repeated dataset_copies times to stand in for a large dataset with a small model
+
+#include "neuralNetwork.hpp"
+#include "dataExtract.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <utility>
+#include <vector>
+
+int main(int argc, char** argv){
+    int epochs = argc > 1 ? std::atoi(argv[1]) : 20;
+    int copies = argc > 2 ? std::atoi(argv[2]) : 50;
+    unsigned int max_threads = argc > 3 ? static_cast<unsigned int>(std::atoi(argv[3])) : std::thread::hardware_concurrency();
+    if(max_threads == 0) max_threads = 1;
+
+    DataSplit data = getCsvData();
+    std::vector<double> features;
+    std::vector<unsigned int> labels;
+    for(int c = 0; c < copies; c++){
+        const double* first = data.training.feature_row(0);
+        features.insert(features.end(), first, first + data.training.size() * data.training.num_features());
+        labels.insert(labels.end(), data.training.labels(), data.training.labels() + data.training.size());
+    }
+    Dataset repeated(data.training.num_features(), std::move(features), std::move(labels), data.data.get_class_names());
+    DatasetView training = repeated.view();
+
+    double samples = static_cast<double>(training.size()) * epochs;
+    const double learning_rate = 0.1;
+    using clock = std::chrono::steady_clock;
+
+    std::printf("%zu training samples x %d epochs, test split of %zu\n\n", training.size(), epochs, data.testing.size());
+    std::printf("%-12s %8s %14s %9s %10s\n", "mode", "threads", "samples/s", "speedup", "accuracy");
+
+    NeuralNetwork sequential(4, 5, 3);
+    auto start = clock::now();
+    for(int epoch = 0; epoch < epochs; epoch++){
+        sequential.train_epoch(training, learning_rate);
+    }
+    double sequential_time = std::chrono::duration<double>(clock::now() - start).count();
+    double sequential_rate = samples / sequential_time;
+    std::printf("%-12s %8u %14.0f %9.2f %9.2f%%\n", "sequential", 1u, sequential_rate, 1.0, sequential.evaluate(data.testing));
+
+    for(unsigned int threads = 1; threads <= max_threads; threads *= 2){
+        NeuralNetwork nn(4, 5, 3);
+        start = clock::now();
+        nn.train_async(training, epochs, learning_rate, threads);
+        double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+        double rate = samples / elapsed;
+        std::printf("%-12s %8u %14.0f %9.2f %9.2f%%\n", "hogwild", threads, rate, rate / sequential_rate, nn.evaluate(data.testing));
+    }
+
+    return 0;
+}
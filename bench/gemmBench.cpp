@@ -0,0 +1,112 @@
+// GFLOP/s report for the blocked GEMM kernels against the original textbook Matrix::operator* loop
+// Usage: gemm_bench [max_size]
+
+#include "gemm.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+// The multiply Matrix used before the contiguous storage and blocked kernels: vector of rows, i-j-k order
+static void naive_multiply(const std::vector<std::vector<double>>& a, const std::vector<std::vector<double>>& b,
+                           std::vector<std::vector<double>>& out){
+    for(size_t i = 0; i < a.size(); i++){
+        for(size_t j = 0; j < b[0].size(); j++){
+            out[i][j] = 0.0;
+            for(size_t k = 0; k < b.size(); k++){
+                out[i][j] += a[i][k] * b[k][j];
+            }
+        }
+    }
+}
+
+// Run fn repeatedly for at least 0.2 seconds and return the best time of a single call in seconds
+template <typename F>
+static double time_best(F fn){
+    using clock = std::chrono::steady_clock;
+    double best = 1e30;
+    auto start = clock::now();
+    do {
+        auto t0 = clock::now();
+        fn();
+        auto t1 = clock::now();
+        best = std::min(best, std::chrono::duration<double>(t1 - t0).count());
+    } while(std::chrono::duration<double>(clock::now() - start).count() < 0.2);
+    return best;
+}
+
+int main(int argc, char** argv){
+    unsigned int max_size = argc > 1 ? static_cast<unsigned int>(std::atoi(argv[1])) : 512;
+
+    std::mt19937 engine(42);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+
+    const GemmKernel kernels[] = {GemmKernel::Scalar, GemmKernel::AVX2, GemmKernel::AVX512};
+    GemmKernel default_kernel = active_gemm_kernel();
+
+    std::printf("default kernel: %s\n\n", gemm_kernel_name(default_kernel));
+    std::printf("%6s %8s %10s", "size", "variant", "naive");
+    for(GemmKernel kernel : kernels){
+        if(gemm_kernel_supported(kernel)) std::printf(" %10s", gemm_kernel_name(kernel));
+    }
+    std::printf(" %10s\n", "max err");
+
+    for(unsigned int n = 32; n <= max_size; n *= 2){
+        std::vector<double> a(n * n), b(n * n), c(n * n), reference(n * n);
+        for(double& v : a) v = dist(engine);
+        for(double& v : b) v = dist(engine);
+
+        std::vector<std::vector<double>> a2(n, std::vector<double>(n)), b2(n, std::vector<double>(n)), c2(n, std::vector<double>(n));
+        for(unsigned int i = 0; i < n; i++){
+            for(unsigned int j = 0; j < n; j++){
+                a2[i][j] = a[i * n + j];
+                b2[i][j] = b[i * n + j];
+            }
+        }
+
+        double flops = 2.0 * n * n * n;
+        double naive_time = time_best([&]{ naive_multiply(a2, b2, c2); });
+
+        const char* variant_names[] = {"A*B", "At*B", "A*Bt"};
+        for(int variant = 0; variant < 3; variant++){
+            bool transpose_a = variant == 1;
+            bool transpose_b = variant == 2;
+
+            // Reference result for this variant from the naive loop on explicitly transposed copies
+            std::vector<std::vector<double>> lhs = a2, rhs = b2;
+            for(unsigned int i = 0; i < n; i++){
+                for(unsigned int j = 0; j < n; j++){
+                    if(transpose_a) lhs[i][j] = a2[j][i];
+                    if(transpose_b) rhs[i][j] = b2[j][i];
+                }
+            }
+            naive_multiply(lhs, rhs, c2);
+            for(unsigned int i = 0; i < n; i++){
+                for(unsigned int j = 0; j < n; j++) reference[i * n + j] = c2[i][j];
+            }
+
+            if(variant == 0) std::printf("%6u %8s %10.2f", n, variant_names[variant], flops / naive_time * 1e-9);
+            else             std::printf("%6u %8s %10s", n, variant_names[variant], "-");
+
+            double max_err = 0.0;
+            for(GemmKernel kernel : kernels){
+                if(!set_gemm_kernel(kernel)) continue;
+                double t = time_best([&]{
+                    gemm(transpose_a, transpose_b, n, n, n, 1.0, a.data(), n, b.data(), n, 0.0, c.data(), n);
+                });
+                for(size_t i = 0; i < c.size(); i++){
+                    max_err = std::max(max_err, std::fabs(c[i] - reference[i]));
+                }
+                std::printf(" %10.2f", flops / t * 1e-9);
+            }
+            std::printf(" %10.1e\n", max_err);
+        }
+    }
+
+    set_gemm_kernel(default_kernel);
+    std::printf("\nGFLOP/s, best of repeated runs. naive is the original vector<vector<double>> i-j-k loop\n");
+    return 0;
+}
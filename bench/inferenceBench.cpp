@@ -0,0 +1,109 @@
+// Accuracy and per-prediction latency of the frozen InferenceModel against the double precision network
+// Usage: inference_bench [epochs]
+
+#include "inferenceModel.hpp"
+#include "neuralNetwork.hpp"
+#include "dataExtract.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// Keeps the compiler from optimizing away predictions whose results are otherwise unused
+static volatile unsigned int sink;
+
+template <typename F>
+static double nanoseconds_per_call(std::size_t calls_per_run, F fn){
+    using clock = std::chrono::steady_clock;
+    double best = 1e30;
+    for(int run = 0; run < 20; run++){
+        auto start = clock::now();
+        fn();
+        double elapsed = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+        best = std::min(best, elapsed / calls_per_run);
+    }
+    return best;
+}
+
+template <typename Model>
+static double model_accuracy(const Model& model, const std::vector<float>& features, const DatasetView& samples){
+    int correct = 0;
+    for(std::size_t i = 0; i < samples.size(); i++){
+        unsigned int label = model.classify(&features[i * 4]).label;
+        if(label == samples.label(i)) correct++;
+    }
+    return (double)correct / samples.size() * 100.0;
+}
+
+int main(int argc, char** argv){
+    int epochs = argc > 1 ? std::atoi(argv[1]) : 1000;
+
+    DataSplit data = getCsvData();
+    const DatasetView& testing = data.testing;
+
+    NeuralNetwork nn(4, 5, 3);
+    for(int epoch = 0; epoch < epochs; epoch++){
+        nn.train_epoch(data.training, 0.1);
+    }
+
+    IrisInferenceModel model = IrisInferenceModel::compile(nn);
+    IrisInferenceModelInt8 model_int8 = IrisInferenceModelInt8::compile(nn);
+
+    // Test features packed as float rows in the same column order the network was trained on
+    std::vector<float> features;
+    for(std::size_t i = 0; i < testing.size(); i++){
+        const double* row = testing.feature_row(i);
+        features.insert(features.end(), row, row + 4);
+    }
+
+    double reference = nn.evaluate(testing);
+    double accuracy_f32 = model_accuracy(model, features, testing);
+    double accuracy_i8 = model_accuracy(model_int8, features, testing);
+
+    std::printf("test accuracy: double %.2f%%, float32 %.2f%%, int8 %.2f%%\n", reference, accuracy_f32, accuracy_i8);
+
+    // Single sample latency over a stream of repeated test rows
+    const std::size_t repeats = 2000;
+    const std::size_t calls = repeats * testing.size();
+
+    InferenceWorkspace ws;
+    double ns_double = nanoseconds_per_call(calls, [&]{
+        for(std::size_t r = 0; r < repeats; r++){
+            for(std::size_t i = 0; i < testing.size(); i++){
+                sink = argmax_row(nn.predict_batch(testing.slice(i, 1).features(), ws), 0);
+            }
+        }
+    });
+
+    double ns_f32 = nanoseconds_per_call(calls, [&]{
+        for(std::size_t r = 0; r < repeats; r++){
+            for(std::size_t i = 0; i < testing.size(); i++){
+                sink = model.classify(&features[i * 4]).label;
+            }
+        }
+    });
+
+    double ns_i8 = nanoseconds_per_call(calls, [&]{
+        for(std::size_t r = 0; r < repeats; r++){
+            for(std::size_t i = 0; i < testing.size(); i++){
+                sink = model_int8.classify(&features[i * 4]).label;
+            }
+        }
+    });
+
+    std::vector<IrisInferenceModel::Prediction> predictions(testing.size());
+    double ns_batch = nanoseconds_per_call(calls, [&]{
+        for(std::size_t r = 0; r < repeats; r++){
+            model.classify_batch(features.data(), testing.size(), predictions.data());
+            sink = predictions[0].label;
+        }
+    });
+
+    std::printf("latency per prediction:\n");
+    std::printf("  NeuralNetwork::predict_batch, batch of 1 %8.1f ns\n", ns_double);
+    std::printf("  InferenceModel float32 classify          %8.1f ns\n", ns_f32);
+    std::printf("  InferenceModel int8 classify             %8.1f ns\n", ns_i8);
+    std::printf("  InferenceModel float32 classify_batch    %8.1f ns\n", ns_batch);
+
+    return accuracy_f32 == reference ? 0 : 1;
+}
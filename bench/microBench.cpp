@@ -0,0 +1,392 @@
+// Microbenchmarks of the hot paths with a machine-readable report and a regression check against a stored baseline
+// Usage: micro_bench [--filter text] [--json path] [--baseline path | --local-baseline path] [--threshold fraction]
+//                    [--repeat n]
+//   --filter          only run benchmarks whose name contains text
+//   --json            write the results as JSON to path, - for stdout
+//   --baseline        compare against a JSON report written earlier, exit with status 1 if any benchmark is slower than
+//                     its baseline by more than the threshold (default 0.25, i.e. 25%), or with status 2 without running
+//                     anything if the baseline was recorded with another GEMM kernel than the one this machine uses
+//   --local-baseline  like --baseline if path exists, otherwise record this run there for the next runs to compare against
+//   --repeat          run every benchmark in n rounds (default 3), each run with its own setup
+// Reports hold the median run of each benchmark. A benchmark regresses when even its fastest run is slower than the
+// baseline by more than the threshold, one that looks like it is gets measured again first, and the loading
+// benchmarks, which mostly time the file system, get twice the threshold
+// Run from the repository root so data/iris.data is found. Timings only compare on the machine and build type the
+// baseline was recorded with: bench/baseline.json is a reference from one machine, perf_check keeps a baseline of its
+// own in the build directory
+
+#include "neuralNetwork.hpp"
+#include "dataExtract.hpp"
+#include "activations.hpp"
+#include "gemm.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct BenchResult {
+    std::string name;
+    double ns_per_op;
+    unsigned long long iterations;
+};
+
+// A named benchmark, run with its name, io_bound marks the ones dominated by file system work
+struct BenchCase {
+    BenchCase(std::string name, std::function<BenchResult(const std::string&)> run, bool io_bound = false)
+        : name(std::move(name)), run(std::move(run)), io_bound(io_bound) {}
+
+    std::string name;
+    std::function<BenchResult(const std::string&)> run;
+    bool io_bound;
+};
+
+// Extra runs of a benchmark that looks slower than the threshold before it counts as a regression, a real regression
+// stays slow so they only cost time when something did get slower
+static const int REGRESSION_RETRIES = 5;
+
+// File system timings swing with page cache and disk load far more than compute does
+static const double IO_THRESHOLD_SCALE = 2.0;
+
+// Keeps results alive so the optimizer cannot drop the work being timed
+static volatile double sink;
+
+// Calls fn in batches of at least a millisecond for at least min_seconds and returns the best batch's time per call
+// The best batch rather than the mean keeps scheduler noise and frequency ramps out of the comparison with the baseline
+template <typename F>
+static BenchResult measure(const std::string& name, F fn, double min_seconds = 0.2){
+    using clock = std::chrono::steady_clock;
+
+    fn();
+    unsigned long long batch = 1;
+    while(true){
+        auto t0 = clock::now();
+        for(unsigned long long i = 0; i < batch; i++) fn();
+        if(std::chrono::duration<double>(clock::now() - t0).count() >= 1e-3 || batch >= (1ull << 30)) break;
+        batch *= 2;
+    }
+
+    double best = 1e30;
+    unsigned long long total = 0;
+    auto start = clock::now();
+    do {
+        auto t0 = clock::now();
+        for(unsigned long long i = 0; i < batch; i++) fn();
+        double seconds = std::chrono::duration<double>(clock::now() - t0).count();
+        best = std::min(best, seconds / batch);
+        total += batch;
+    } while(std::chrono::duration<double>(clock::now() - start).count() < min_seconds);
+
+    return BenchResult{name, best * 1e9, total};
+}
+
+// The training split repeated copies times, standing in for a larger dataset of the same shape
+static Dataset repeat_dataset(const DatasetView& samples, const std::vector<std::string>& class_names, unsigned int copies){
+    std::vector<double> features;
+    std::vector<unsigned int> labels;
+    for(unsigned int c = 0; c < copies; c++){
+        const double* first = samples.feature_row(0);
+        features.insert(features.end(), first, first + samples.size() * samples.num_features());
+        labels.insert(labels.end(), samples.labels(), samples.labels() + samples.size());
+    }
+    return Dataset(samples.num_features(), std::move(features), std::move(labels), class_names);
+}
+
+// The CSV repeated copies times in a temporary file, returns its path
+static std::string repeat_csv(const std::string& path, unsigned int copies){
+    std::ifstream in(path, std::ios::binary);
+    std::stringstream contents;
+    contents << in.rdbuf();
+
+    std::string out_path = (std::filesystem::temp_directory_path() / ("iris_bench_x" + std::to_string(copies) + ".data")).string();
+    std::ofstream out(out_path, std::ios::binary | std::ios::trunc);
+    for(unsigned int c = 0; c < copies; c++){
+        out << contents.str();
+    }
+    return out_path;
+}
+
+static void matrix_benchmarks(std::vector<BenchCase>& cases){
+    for(unsigned int n : {16u, 64u, 256u}){
+        std::string size = std::to_string(n);
+
+        cases.emplace_back("matrix_multiply/" + size, [n](const std::string& name){
+            std::mt19937 engine(42);
+            Matrix a = Matrix::random(n, n, engine, -1.0, 1.0);
+            Matrix b = Matrix::random(n, n, engine, -1.0, 1.0);
+            return measure(name, [&]{ Matrix c = a * b; sink = c.data()[0]; });
+        });
+
+        cases.emplace_back("matrix_transpose/" + size, [n](const std::string& name){
+            std::mt19937 engine(42);
+            Matrix a = Matrix::random(n, n, engine, -1.0, 1.0);
+            Matrix out;
+            return measure(name, [&]{ a.transpose_into(out); sink = out.data()[1]; });
+        });
+
+        cases.emplace_back("matrix_elementwise/" + size, [n](const std::string& name){
+            std::mt19937 engine(42);
+            Matrix a = Matrix::random(n, n, engine, -1.0, 1.0);
+            Matrix b = Matrix::random(n, n, engine, -1.0, 1.0);
+            Matrix out(n, n);
+            return measure(name, [&]{ out = a + b * 0.5; sink = out.data()[0]; });
+        });
+
+        for(ActivationPrecision precision : {ActivationPrecision::Exact, ActivationPrecision::Fast}){
+            cases.emplace_back(std::string("sigmoid_") + activation_precision_name(precision) + "/" + size, [n, precision](const std::string& name){
+                std::mt19937 engine(42);
+                Matrix z = Matrix::random(n, n, engine, -4.0, 4.0);
+                Matrix a(n, n);
+                ActivationPrecision previous = active_activation_precision();
+                set_activation_precision(precision);
+                BenchResult result = measure(name, [&]{ apply_activation(Activation::Sigmoid, z.data(), a.data(), z.size(), n); sink = a.data()[0]; });
+                set_activation_precision(previous);
+                return result;
+            });
+        }
+    }
+}
+
+static void network_benchmarks(std::vector<BenchCase>& cases, const DataSplit& data){
+    for(unsigned int batch : {1u, 32u, 256u}){
+        std::string size = std::to_string(batch);
+
+        // Inputs and targets cycled from the training split up to the batch size
+        auto make_batch = [&data, batch](Matrix& input, Matrix& target){
+            const DatasetView& training = data.training;
+            input = Matrix(batch, training.num_features());
+            target = Matrix(batch, training.num_classes());
+            for(unsigned int i = 0; i < batch; i++){
+                std::memcpy(input.row(i), training.feature_row(i % training.size()), training.num_features() * sizeof(double));
+                std::memcpy(target.row(i), training.target_row(i % training.size()), training.num_classes() * sizeof(double));
+            }
+        };
+
+        cases.emplace_back("forward_propagation/" + size, [make_batch](const std::string& name){
+            NeuralNetwork nn(4, 5, 3);
+            Matrix input, target;
+            make_batch(input, target);
+            return measure(name, [&]{ sink = nn.forward_propagation(input).data()[0]; });
+        });
+
+        cases.emplace_back("back_propagation/" + size, [make_batch](const std::string& name){
+            NeuralNetwork nn(4, 5, 3);
+            Matrix input, target;
+            make_batch(input, target);
+            nn.forward_propagation(input);
+            return measure(name, [&]{ sink = nn.back_propagation(input, target).data()[0]; });
+        });
+    }
+
+    // One epoch of per-sample SGD on the training split and on a 16 times larger copy of it
+    for(unsigned int copies : {1u, 16u}){
+        cases.emplace_back("train_epoch/x" + std::to_string(copies), [&data, copies](const std::string& name){
+            Dataset repeated = repeat_dataset(data.training, data.data.get_class_names(), copies);
+            NeuralNetwork nn(4, 5, 3);
+            return measure(name, [&]{ sink = nn.train_epoch(repeated.view(), 0.1); });
+        });
+    }
+}
+
+static void loading_benchmarks(std::vector<BenchCase>& cases){
+    for(unsigned int copies : {1u, 64u}){
+        std::string scale = "x" + std::to_string(copies);
+
+        // Parsing the text alone, and the full getCsvData, which maps the binary cache once it exists
+        cases.emplace_back("csv_parse/" + scale, [copies](const std::string& name){
+            std::string path = repeat_csv("data/iris.data", copies);
+            BenchResult result = measure(name, [&]{ sink = static_cast<double>(readCsvDataset(path).data.size()); });
+            std::filesystem::remove(path);
+            return result;
+        }, true);
+
+        cases.emplace_back("get_csv_data/" + scale, [copies](const std::string& name){
+            std::string path = repeat_csv("data/iris.data", copies);
+            BenchResult result = measure(name, [&]{ sink = static_cast<double>(getCsvData(path, 1).training.size()); });
+            std::filesystem::remove(path);
+            std::filesystem::remove(datasetCachePath(path));
+            return result;
+        }, true);
+    }
+}
+
+static void write_json(std::ostream& out, const std::vector<BenchResult>& results){
+    out << "{\n  \"gemm_kernel\": \"" << gemm_kernel_name(active_gemm_kernel()) << "\",\n  \"results\": [\n";
+    for(std::size_t i = 0; i < results.size(); i++){
+        char line[256];
+        std::snprintf(line, sizeof(line), "    {\"name\": \"%s\", \"ns_per_op\": %.1f, \"iterations\": %llu}%s\n",
+                      results[i].name.c_str(), results[i].ns_per_op, results[i].iterations, i + 1 < results.size() ? "," : "");
+        out << line;
+    }
+    out << "  ]\n}\n";
+}
+
+// Reads back the name / ns_per_op pairs of a report written by write_json and the GEMM kernel it was recorded with,
+// empty if the report does not say, anything else in the file is ignored
+static std::map<std::string, double> read_baseline(const std::string& path, std::string& gemm_kernel){
+    std::ifstream in(path);
+    if(!in){
+        std::fprintf(stderr, "Could not open baseline %s\n", path.c_str());
+        std::exit(2);
+    }
+    std::stringstream contents;
+    contents << in.rdbuf();
+    std::string text = contents.str();
+
+    const std::string kernel_key = "\"gemm_kernel\": \"";
+    std::size_t kernel_pos = text.find(kernel_key);
+    gemm_kernel.clear();
+    if(kernel_pos != std::string::npos){
+        kernel_pos += kernel_key.size();
+        gemm_kernel = text.substr(kernel_pos, text.find('"', kernel_pos) - kernel_pos);
+    }
+
+    std::map<std::string, double> baseline;
+    const std::string name_key = "\"name\": \"";
+    const std::string time_key = "\"ns_per_op\": ";
+    for(std::size_t pos = text.find(name_key); pos != std::string::npos; pos = text.find(name_key, pos)){
+        pos += name_key.size();
+        std::size_t name_end = text.find('"', pos);
+        std::size_t time_pos = text.find(time_key, name_end);
+        if(name_end == std::string::npos || time_pos == std::string::npos) break;
+        baseline[text.substr(pos, name_end - pos)] = std::strtod(text.c_str() + time_pos + time_key.size(), nullptr);
+        pos = time_pos;
+    }
+    return baseline;
+}
+
+int main(int argc, char** argv){
+    std::string filter, json_path, baseline_path, local_baseline_path;
+    double threshold = 0.25;
+    int repeat = 3;
+    for(int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        if(i + 1 >= argc){
+            std::fprintf(stderr, "Missing value for %s\n", arg.c_str());
+            return 2;
+        }
+        if(arg == "--filter") filter = argv[++i];
+        else if(arg == "--json") json_path = argv[++i];
+        else if(arg == "--baseline") baseline_path = argv[++i];
+        else if(arg == "--local-baseline") local_baseline_path = argv[++i];
+        else if(arg == "--threshold") threshold = std::atof(argv[++i]);
+        else if(arg == "--repeat") repeat = std::max(1, std::atoi(argv[++i]));
+        else {
+            std::fprintf(stderr, "Unknown option %s\n", arg.c_str());
+            return 2;
+        }
+    }
+
+    if(!baseline_path.empty() && !local_baseline_path.empty()){
+        std::fprintf(stderr, "--baseline and --local-baseline cannot be combined\n");
+        return 2;
+    }
+
+    // The first run with a local baseline records it, every later one compares against it
+    std::string record_path;
+    if(!local_baseline_path.empty()){
+        if(std::filesystem::exists(local_baseline_path)) baseline_path = local_baseline_path;
+        else record_path = local_baseline_path;
+    }
+
+    DataSplit data = getCsvData("data/iris.data", 1);
+
+    std::vector<BenchCase> cases;
+    matrix_benchmarks(cases);
+    network_benchmarks(cases, data);
+    loading_benchmarks(cases);
+
+    // Timings of different kernels say nothing about each other, comparing them would report noise as regressions
+    std::map<std::string, double> baseline;
+    if(!baseline_path.empty()){
+        std::string baseline_kernel;
+        baseline = read_baseline(baseline_path, baseline_kernel);
+        std::string kernel = gemm_kernel_name(active_gemm_kernel());
+        if(baseline_kernel != kernel){
+            std::fprintf(stderr, "Baseline %s was recorded with the %s GEMM kernel but this machine uses %s, not comparing.\n"
+                         "Record a baseline for this machine with --json\n",
+                         baseline_path.c_str(), baseline_kernel.empty() ? "unknown" : baseline_kernel.c_str(), kernel.c_str());
+            return 2;
+        }
+    }
+
+    std::vector<BenchCase*> selected;
+    for(BenchCase& entry : cases){
+        if(filter.empty() || entry.name.find(filter) != std::string::npos) selected.push_back(&entry);
+    }
+
+    // Rounds over every selected benchmark rather than back to back runs of one, so a slow spell of the machine hits
+    // one run of many benchmarks instead of every run of one
+    std::vector<std::vector<BenchResult>> runs(selected.size());
+    for(int round = 0; round < repeat; round++){
+        for(std::size_t i = 0; i < selected.size(); i++){
+            runs[i].push_back(selected[i]->run(selected[i]->name));
+        }
+    }
+
+    // The report holds the median run, the typical time a later run is held to, while the check uses the fastest run,
+    // so one lucky run can neither set an unreachable baseline nor hide a slowdown that every run shows
+    std::vector<BenchResult> results;
+    std::vector<double> fastest;
+    for(std::vector<BenchResult>& times : runs){
+        std::sort(times.begin(), times.end(), [](const BenchResult& a, const BenchResult& b){ return a.ns_per_op < b.ns_per_op; });
+        results.push_back(times[times.size() / 2]);
+        fastest.push_back(times.front().ns_per_op);
+    }
+
+    // Progress goes to stderr so --json - leaves a clean report on stdout
+    int regressions = 0;
+    std::fprintf(stderr, "%-28s %14s %14s %9s\n", "benchmark", "ns/op", "baseline", "change");
+    for(std::size_t i = 0; i < selected.size(); i++){
+        BenchCase& entry = *selected[i];
+        double& best = fastest[i];
+
+        auto previous = baseline.find(entry.name);
+        if(previous == baseline.end() || previous->second <= 0.0){
+            std::fprintf(stderr, "%-28s %14.1f %14s %9s\n", entry.name.c_str(), best, "-", "-");
+            continue;
+        }
+
+        double limit = entry.io_bound ? threshold * IO_THRESHOLD_SCALE : threshold;
+        for(int retry = 0; retry < REGRESSION_RETRIES && best > previous->second * (1.0 + limit); retry++){
+            best = std::min(best, entry.run(entry.name).ns_per_op);
+        }
+
+        double change = best / previous->second - 1.0;
+        bool regressed = change > limit;
+        regressions += regressed ? 1 : 0;
+        std::fprintf(stderr, "%-28s %14.1f %14.1f %+8.1f%%%s\n", entry.name.c_str(), best, previous->second,
+                     change * 100.0, regressed ? "  REGRESSION" : "");
+    }
+
+    if(json_path == "-"){
+        std::ostringstream out;
+        write_json(out, results);
+        std::fputs(out.str().c_str(), stdout);
+    } else if(!json_path.empty()){
+        std::ofstream out(json_path, std::ios::trunc);
+        write_json(out, results);
+    }
+
+    if(!record_path.empty()){
+        std::ofstream out(record_path, std::ios::trunc);
+        write_json(out, results);
+        std::fprintf(stderr, "\nRecorded %s as the baseline for later runs, delete it to record a new one\n", record_path.c_str());
+    }
+
+    if(regressions > 0){
+        std::fprintf(stderr, "\n%d benchmark(s) more than %.0f%% (loading %.0f%%) slower than the baseline\n", regressions,
+                     threshold * 100.0, threshold * IO_THRESHOLD_SCALE * 100.0);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,367 @@
+// Headless front end: train a model, evaluate it on labelled data, or score a stream of measurements
+// Usage: iris_cli train [--data path] [--model path] [--epochs n] [--learning-rate r] [--batch n] [--hidden n[,n...]]
+//                       [--loss mse|cross-entropy] [--optimizer sgd|momentum|rmsprop|adam] [--schedule name]
+//                       [--patience n] [--validation fraction] [--threads n] [--report n]
+//        iris_cli eval --model path [--data path] [--holdout] [--threads n]
+//        iris_cli score --model path [--input path|-] [--output path|-] [--batch n] [--threads n] [--probabilities]
+//                       [--precision digits] [--classes name,name,...] [--header]
+// Every subcommand also takes --profile path and --trace path, which need a build with IRIS_PROFILING
+
+#include "batchScorer.hpp"
+#include "dataExtract.hpp"
+#include "modelFile.hpp"
+#include "neuralNetwork.hpp"
+#include "profiler.hpp"
+#include "trainer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+static void print_usage(){
+    std::cerr <<
+        "usage: iris_cli train [--data path] [--model path] [--epochs n] [--learning-rate r] [--batch n]\n"
+        "                      [--hidden n[,n...]] [--loss mse|cross-entropy] [--optimizer sgd|momentum|rmsprop|adam]\n"
+        "                      [--schedule constant|step|exponential|cosine|plateau] [--patience n]\n"
+        "                      [--validation fraction] [--threads n] [--report n]\n"
+        "       iris_cli eval --model path [--data path] [--holdout] [--threads n]\n"
+        "       iris_cli score --model path [--input path|-] [--output path|-] [--batch n] [--threads n]\n"
+        "                      [--probabilities] [--precision digits] [--classes name,name,...] [--header]\n"
+        "every subcommand also takes --profile path and --trace path\n";
+}
+
+// The --name value pairs and bare --flags of one subcommand, anything not listed for it is rejected
+class Arguments {
+public:
+    Arguments(int argc, char** argv, const std::set<std::string>& options, const std::set<std::string>& flags){
+        for(int i = 2; i < argc; i++){
+            std::string arg = argv[i];
+            if(flags.count(arg)){
+                values[arg] = "";
+            } else if(options.count(arg) || arg == "--profile" || arg == "--trace"){
+                if(i + 1 >= argc){
+                    throw std::invalid_argument("missing value for " + arg);
+                }
+                values[arg] = argv[++i];
+            } else {
+                throw std::invalid_argument("unknown argument " + arg);
+            }
+        }
+    }
+
+    bool has(const std::string& name) const { return values.count(name) != 0; }
+
+    std::string text(const std::string& name, const std::string& fallback) const {
+        auto found = values.find(name);
+        return found == values.end() ? fallback : found->second;
+    }
+
+    double number(const std::string& name, double fallback) const {
+        if(!has(name)) return fallback;
+        const std::string& text = values.at(name);
+        std::size_t used = 0;
+        double value = 0.0;
+        try {
+            value = std::stod(text, &used);
+        } catch(const std::logic_error&){
+            used = 0;
+        }
+        if(used == 0 || used != text.size()){
+            throw std::invalid_argument(name + " expects a number, got '" + text + "'");
+        }
+        return value;
+    }
+
+    unsigned int count(const std::string& name, unsigned int fallback) const {
+        double value = number(name, fallback);
+        if(value < 0 || value != static_cast<unsigned int>(value)){
+            throw std::invalid_argument(name + " expects a whole number");
+        }
+        return static_cast<unsigned int>(value);
+    }
+
+private:
+    std::map<std::string, std::string> values;
+};
+
+static std::vector<std::string> split_list(const std::string& text){
+    std::vector<std::string> items;
+    std::size_t start = 0;
+    while(start <= text.size()){
+        std::size_t comma = text.find(',', start);
+        if(comma == std::string::npos) comma = text.size();
+        items.push_back(text.substr(start, comma - start));
+        start = comma + 1;
+    }
+    return items;
+}
+
+static unsigned int default_threads(){
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+static OptimizerSpec parse_optimizer(const std::string& name){
+    if(name == "sgd") return OptimizerSpec::sgd();
+    if(name == "momentum") return OptimizerSpec::momentum();
+    if(name == "rmsprop") return OptimizerSpec::rmsprop();
+    if(name == "adam") return OptimizerSpec::adam();
+    throw std::invalid_argument("unknown optimizer " + name);
+}
+
+static LearningRateSchedule parse_schedule(const std::string& name){
+    if(name == "constant") return LearningRateSchedule::Constant;
+    if(name == "step") return LearningRateSchedule::Step;
+    if(name == "exponential") return LearningRateSchedule::Exponential;
+    if(name == "cosine") return LearningRateSchedule::Cosine;
+    if(name == "plateau") return LearningRateSchedule::ReduceOnPlateau;
+    throw std::invalid_argument("unknown schedule " + name);
+}
+
+// Sigmoid hidden layers of the given widths, then a sigmoid output on squared error or a softmax one on cross-entropy
+static NetworkSpec build_spec(unsigned int inputs, const std::string& hidden, const std::string& loss, unsigned int outputs){
+    bool cross_entropy = loss == "cross-entropy";
+    if(!cross_entropy && loss != "mse"){
+        throw std::invalid_argument("unknown loss " + loss);
+    }
+
+    NetworkSpec spec(inputs);
+    for(const std::string& width : split_list(hidden)){
+        std::size_t used = 0;
+        unsigned long units = 0;
+        try {
+            units = std::stoul(width, &used);
+        } catch(const std::logic_error&){
+            used = 0;
+        }
+        if(used == 0 || used != width.size() || units == 0){
+            throw std::invalid_argument("--hidden expects comma-separated layer widths");
+        }
+        spec.dense(static_cast<unsigned int>(units)).activation(Activation::Sigmoid);
+    }
+    spec.dense(outputs).activation(cross_entropy ? Activation::Softmax : Activation::Sigmoid);
+    spec.loss(cross_entropy ? Loss::CrossEntropy : Loss::MeanSquaredError);
+    return spec;
+}
+
+static void report_csv_errors(const std::string& path, const std::vector<CsvError>& errors, std::size_t malformed_lines){
+    for(const CsvError& error : errors){
+        std::cerr << path << ":" << error.line << ": " << error.message << "\n";
+    }
+    if(malformed_lines > errors.size()){
+        std::cerr << path << ": " << malformed_lines - errors.size() << " more malformed lines\n";
+    }
+}
+
+static int run_train(const Arguments& args){
+    std::string data_path = args.text("--data", "data/iris.data");
+    std::string model_path = args.text("--model", "iris.model");
+    unsigned int threads = args.count("--threads", 1);
+    unsigned int report_every = args.count("--report", 100);
+
+    DataSplit data = getCsvData(data_path, default_threads());
+    if(data.training.empty()){
+        throw std::runtime_error("no samples to train on in " + data_path);
+    }
+
+    NeuralNetwork nn(build_spec(data.data.num_features(), args.text("--hidden", "5"), args.text("--loss", "mse"), data.data.num_classes()));
+    nn.set_normalizer(data.normalizer);
+    nn.set_optimizer(parse_optimizer(args.text("--optimizer", "sgd")));
+    nn.set_num_threads(threads);
+
+    TrainingOptions options;
+    options.max_epochs = args.count("--epochs", 1000);
+    options.learning_rate = args.number("--learning-rate", 0.1);
+    options.batch_size = args.count("--batch", 1);
+    options.schedule = parse_schedule(args.text("--schedule", "constant"));
+    options.patience = args.count("--patience", 0);
+
+    // Early stopping watches held out samples, by default a fifth of the training split
+    double validation = args.number("--validation", options.patience != 0 ? 0.2 : 0.0);
+    ValidationSplit split{data.training, DatasetView()};
+    if(validation > 0.0){
+        split = hold_out(data.training, validation);
+    }
+
+    TrainingController controller(nn, split.training, split.validation, options);
+    controller.on_epoch([report_every](const EpochReport& report){
+        if(report_every != 0 && report.epochs_run % report_every == 0){
+            std::cout << "epoch " << report.epoch << " cost " << report.training_cost << " monitored " << report.monitored_loss
+                      << " rate " << report.learning_rate << "\n";
+        }
+        return true;
+    });
+    const TrainingResult& result = controller.run();
+
+    std::cout << result.epochs_run << " epochs in " << result.elapsed_seconds << " s, " << stop_reason_name(result.reason)
+              << ", best epoch " << result.best_epoch << "\n";
+    std::cout << "test accuracy " << nn.evaluate(data.testing) << "% on " << data.testing.size() << " samples\n";
+
+    nn.save(model_path);
+    std::cout << "saved " << model_path << "\n";
+    return 0;
+}
+
+static int run_eval(const Arguments& args){
+    if(!args.has("--model")){
+        throw std::invalid_argument("eval needs --model");
+    }
+    std::string data_path = args.text("--data", "data/iris.data");
+    NeuralNetwork nn = NeuralNetwork::load(args.text("--model", ""));
+
+    CsvParseResult parsed = loadCsvDataset(data_path, args.count("--threads", default_threads()));
+    report_csv_errors(data_path, parsed.errors, parsed.malformed_lines);
+    if(parsed.data.num_classes() != nn.get_layers().output_size()){
+        throw std::runtime_error(data_path + " has " + std::to_string(parsed.data.num_classes()) + " classes but the model has " +
+                                 std::to_string(nn.get_layers().output_size()) + " outputs");
+    }
+
+    // Normalizing copies a mapped dataset into memory, so the views are only taken afterwards
+    nn.get_normalizer().apply(parsed.data);
+
+    // --holdout evaluates only the samples train held out for testing, by repeating its shuffle and split
+    DatasetView samples = parsed.data.view();
+    if(args.has("--holdout")){
+        shuffleDataset(parsed.data);
+        std::size_t trainNum = parsed.data.size() * 4 / 5;
+        samples = parsed.data.slice(trainNum, parsed.data.size() - trainNum);
+    }
+
+    if(samples.empty()){
+        throw std::runtime_error("no samples to evaluate in " + data_path);
+    }
+
+    InferenceWorkspace ws;
+    MatrixView output = nn.predict_batch(samples.features(), ws);
+    unsigned int classes = parsed.data.num_classes();
+    std::vector<std::size_t> confusion(classes * classes);
+    std::size_t correct = 0;
+    for(std::size_t i = 0; i < samples.size(); i++){
+        unsigned int predicted = argmax_row(output, static_cast<unsigned int>(i));
+        confusion[samples.label(i) * classes + predicted]++;
+        if(predicted == samples.label(i)) correct++;
+    }
+
+    std::cout << "accuracy " << 100.0 * correct / samples.size() << "% (" << correct << " / " << samples.size() << ")\n";
+    std::cout << "confusion matrix, rows are the actual class and columns the predicted one\n";
+    for(unsigned int actual = 0; actual < classes; actual++){
+        std::cout << "  " << parsed.data.class_name(actual);
+        for(unsigned int predicted = 0; predicted < classes; predicted++){
+            std::cout << " " << confusion[actual * classes + predicted];
+        }
+        std::cout << "\n";
+    }
+    return 0;
+}
+
+static int run_score(const Arguments& args){
+    if(!args.has("--model")){
+        throw std::invalid_argument("score needs --model");
+    }
+    MappedModel model(args.text("--model", ""));
+
+    ScoreOptions options;
+    options.batch_rows = args.count("--batch", options.batch_rows);
+    options.threads = args.count("--threads", default_threads());
+    options.probabilities = args.has("--probabilities");
+    options.precision = static_cast<int>(args.count("--precision", options.precision));
+    options.skip_header = args.has("--header");
+    if(args.has("--classes")){
+        options.class_names = split_list(args.text("--classes", ""));
+    }
+
+    std::string input_path = args.text("--input", "-");
+    std::string output_path = args.text("--output", "-");
+    std::FILE* in = input_path == "-" ? stdin : std::fopen(input_path.c_str(), "rb");
+    if(in == nullptr){
+        throw std::runtime_error("could not open " + input_path);
+    }
+    std::FILE* out = output_path == "-" ? stdout : std::fopen(output_path.c_str(), "wb");
+    if(out == nullptr){
+        if(in != stdin) std::fclose(in);
+        throw std::runtime_error("could not create " + output_path);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    ScoreStats stats;
+    try {
+        stats = scoreCsvStream(model, in, out, options);
+    } catch(...){
+        if(in != stdin) std::fclose(in);
+        if(out != stdout) std::fclose(out);
+        throw;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if(in != stdin) std::fclose(in);
+    if(out != stdout && std::fclose(out) != 0){
+        throw std::runtime_error("failed to write " + output_path);
+    }
+
+    report_csv_errors(input_path, stats.errors, stats.malformed_lines);
+    std::cerr << "scored " << stats.rows << " rows in " << seconds << " s (" << (seconds > 0.0 ? stats.rows / seconds : 0.0) << " rows/s)\n";
+    return 0;
+}
+
+// The phase timings as JSON and the traced sections as a Chrome trace, if they were asked for
+static void write_profile(const Arguments& args){
+    if((args.has("--profile") || args.has("--trace")) && !profiling_compiled_in()){
+        std::cerr << "iris_cli: built without IRIS_PROFILING, the profile is empty\n";
+    }
+    if(args.has("--profile")){
+        std::ofstream out(args.text("--profile", ""));
+        write_profile_json(out, profile_snapshot());
+    }
+    if(args.has("--trace")){
+        std::ofstream out(args.text("--trace", ""));
+        write_chrome_trace(out);
+    }
+}
+
+int main(int argc, char** argv){
+    if(argc < 2){
+        print_usage();
+        return 2;
+    }
+    std::string command = argv[1];
+
+    try {
+        int status;
+        if(command == "train"){
+            Arguments args(argc, argv, {"--data", "--model", "--epochs", "--learning-rate", "--batch", "--hidden", "--loss", "--optimizer",
+                                        "--schedule", "--patience", "--validation", "--threads", "--report"}, {});
+            profile_set_tracing(args.has("--trace"));
+            status = run_train(args);
+            write_profile(args);
+        } else if(command == "eval"){
+            Arguments args(argc, argv, {"--model", "--data", "--threads"}, {"--holdout"});
+            profile_set_tracing(args.has("--trace"));
+            status = run_eval(args);
+            write_profile(args);
+        } else if(command == "score"){
+            Arguments args(argc, argv, {"--model", "--input", "--output", "--batch", "--threads", "--precision", "--classes"},
+                           {"--probabilities", "--header"});
+            profile_set_tracing(args.has("--trace"));
+            status = run_score(args);
+            write_profile(args);
+        } else {
+            print_usage();
+            return 2;
+        }
+        return status;
+    } catch(const std::invalid_argument& error){
+        std::cerr << "iris_cli " << command << ": " << error.what() << "\n";
+        print_usage();
+        return 2;
+    } catch(const std::exception& error){
+        std::cerr << "iris_cli " << command << ": " << error.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef BACKGROUND_TRAINER_HPP
+#define BACKGROUND_TRAINER_HPP
+
+// Training on a worker thread for interactive front ends
+// The worker runs a TrainingController epoch after epoch and every publish interval copies the parameters, the last
+// epoch report and the activations of one display sample into a SnapshotBuffer, which the UI thread reads without
+// ever blocking on training, whatever the size of the dataset or the length of an epoch.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <thread>
+#include <vector>
+#include "matrix.hpp"
+#include "layers.hpp"
+#include "snapshotBuffer.hpp"
+#include "trainer.hpp"
+
+struct TrainingSnapshot {
+    // Copy of the network's flat parameter buffer, laid out as the network's LayerStack describes
+    Matrix parameters;
+
+    // Normalized inputs of the display sample and the activations of every layer for it
+    std::vector<double> sample;
+    std::vector<std::vector<double>> activations;
+
+    // Report of the last epoch trained, all zeros before the first one
+    EpochReport report{};
+
+    // Epochs trained per second since the previous snapshot
+    double epochs_per_second = 0.0;
+
+    // Set on the last snapshot, published once training has stopped, result is only meaningful then
+    bool finished = false;
+    TrainingResult result{};
+};
+
+class BackgroundTrainer {
+public:
+    // Start training network right away, the display sample of each snapshot cycles through display_samples by epoch
+    // Throws like TrainingController for bad options. The network and the datasets must outlive the trainer, and the
+    // network must not be used by any other thread until finished() is true
+    BackgroundTrainer(NeuralNetwork& network, const DatasetView& training, const DatasetView& validation, const TrainingOptions& options,
+                      const DatasetView& display_samples, std::chrono::milliseconds publish_interval = std::chrono::milliseconds(8));
+
+    // Stops training after the current epoch and waits for the worker
+    ~BackgroundTrainer();
+
+    BackgroundTrainer(const BackgroundTrainer&) = delete;
+    BackgroundTrainer& operator=(const BackgroundTrainer&) = delete;
+
+    // Ask the worker to stop after the epoch it is on, the result then says StopReason::Callback
+    void stop();
+
+    // True once the worker is done and has published its final snapshot
+    bool finished() const { return done.load(std::memory_order_acquire); }
+
+    // Wait for the worker, rethrows anything training threw
+    void wait();
+
+    // Reader side, for one thread only: pick up the latest snapshot, returns false if nothing new was published
+    bool refresh() { return snapshots.refresh(); }
+    const TrainingSnapshot& snapshot() const { return snapshots.front(); }
+
+private:
+    void run();
+    void publish(const EpochReport& report, bool last);
+
+    NeuralNetwork& network;
+    TrainingController controller;
+    DatasetView display_samples;
+    std::chrono::milliseconds publish_interval;
+
+    // Worker only: scratch for the display sample and the pace since the last snapshot
+    InferenceWorkspace display_ws;
+    std::chrono::steady_clock::time_point last_publish;
+    unsigned int last_published_epochs;
+
+    SnapshotBuffer<TrainingSnapshot> snapshots;
+    std::atomic<bool> stop_requested;
+    std::atomic<bool> done;
+    std::exception_ptr error;
+    std::thread worker;
+};
+
+#endif
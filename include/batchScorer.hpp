@@ -0,0 +1,56 @@
+#ifndef BATCH_SCORER_HPP
+#define BATCH_SCORER_HPP
+
+// Streaming batch inference over CSV files of measurements
+// The input is read in fixed-size blocks, each block is cut at newlines into one piece per thread, and every piece is
+// parsed straight into a batch matrix, normalized with the model's normalizer, run through the model a batch at a
+// time and formatted into that piece's output. Memory is bounded by the block and batch sizes, not by the input.
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "dataExtract.hpp"
+#include "modelFile.hpp"
+
+struct ScoreOptions {
+    // Samples per inference batch
+    unsigned int batch_rows = 4096;
+
+    // Threads that parse, score and format the pieces of a block, 1 scores on the calling thread
+    unsigned int threads = 1;
+
+    // Bytes of input read at a time, also the longest line that can be scored
+    std::size_t block_bytes = std::size_t(1) << 20;
+
+    // Also write the output layer's activations after the class, probabilities for a softmax output
+    bool probabilities = false;
+
+    // Significant digits of the written activations
+    int precision = 6;
+
+    // Written instead of the class index when given, one name per output of the model
+    std::vector<std::string> class_names;
+
+    // Skip the first line of the input, e.g. a header row
+    bool skip_header = false;
+};
+
+struct ScoreStats {
+    // Lines read and samples scored, blank and malformed lines are read but not scored
+    std::size_t lines = 0;
+    std::size_t rows = 0;
+
+    // Details of the first CsvBlock::MAX_REPORTED_ERRORS malformed lines, malformed_lines counts all of them
+    std::vector<CsvError> errors;
+    std::size_t malformed_lines = 0;
+};
+
+// Score every line of in and write one line per scored sample to out, in input order: the predicted class, then the
+// activations when options.probabilities is set, comma-separated
+// The first comma-separated fields of a line are the model's inputs in raw units, any further fields (e.g. the class
+// of a labelled file) are ignored. Malformed lines are skipped and reported in the returned stats.
+// Throws std::invalid_argument for options that do not fit the model and std::runtime_error if reading or writing fails
+ScoreStats scoreCsvStream(const MappedModel& model, std::FILE* in, std::FILE* out, const ScoreOptions& options = ScoreOptions());
+
+#endif
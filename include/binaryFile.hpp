@@ -0,0 +1,79 @@
+#ifndef BINARY_FILE_HPP
+#define BINARY_FILE_HPP
+
+// Building blocks shared by the binary file formats (datasetFile.hpp, modelFile.hpp)
+// Every file starts with the same prologue, followed by a header of its own whose offsets point at blocks that each
+// start on a cache line. Files are written next to their final path and renamed into place, and mapped files are
+// checked with the helpers below before anything inside them is trusted.
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include "mappedFile.hpp"
+
+// Every block starts on a cache line, which is also the alignment Matrix uses for its own buffers
+constexpr std::uint64_t SECTION_ALIGNMENT = 64;
+
+// First member of every file header
+struct BinaryFilePrologue {
+    char magic[8];
+    std::uint32_t version;
+
+    // Written in the machine's byte order, a file from a machine of the other order fails the check instead of loading garbage
+    std::uint32_t byte_order;
+
+    std::uint64_t file_size;
+};
+
+// Prologue of a file of the given format, file_size is filled in once the layout is known
+BinaryFilePrologue makeFilePrologue(const char (&magic)[8], std::uint32_t version);
+
+// Round an offset up to the next section boundary
+inline std::uint64_t alignSection(std::uint64_t offset){
+    return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+}
+
+// True if bytes bytes at offset lie inside a file of file_size bytes, without any sum that could wrap around
+inline bool sectionInFile(std::uint64_t offset, std::uint64_t bytes, std::uint64_t file_size){
+    return offset <= file_size && bytes <= file_size - offset;
+}
+
+// True if a prologue has the given magic, version and this machine's byte order, for a quick look without mapping the file
+bool filePrologueMatches(const BinaryFilePrologue& prologue, const char (&magic)[8], std::uint32_t version);
+
+// Check the prologue of a mapped file whose header is header_size bytes long and return it
+// kind names the format in the error messages ("dataset", "model"). Throws std::runtime_error if the file is too small
+// for the header, has another magic, byte order or version, or is not as long as its prologue says
+const BinaryFilePrologue& checkFilePrologue(const MappedFile& file, const std::string& path, const char (&magic)[8],
+                                            std::uint32_t version, std::size_t header_size, const char* kind);
+
+// Writes a file front to back into path + ".tmp" and renames it over path on commit(), so readers never see a
+// partial file. A writer destroyed without committing removes its temporary file
+class SectionWriter {
+public:
+    // Throws std::runtime_error if the temporary file cannot be created
+    explicit SectionWriter(const std::string& path);
+    ~SectionWriter();
+
+    SectionWriter(const SectionWriter&) = delete;
+    SectionWriter& operator=(const SectionWriter&) = delete;
+
+    // Write bytes right after what was written so far
+    void append(const void* data, std::uint64_t bytes);
+
+    // Pad with zeros up to offset, which must not lie behind what was written so far, and write bytes there
+    void write_block(std::uint64_t offset, const void* data, std::uint64_t bytes);
+
+    // Flush and move the file into place, throws std::runtime_error if either fails
+    void commit();
+
+private:
+    std::string path;
+    std::string temporary;
+    std::ofstream out;
+    std::uint64_t position;
+    bool committed;
+};
+
+#endif
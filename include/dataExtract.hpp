@@ -1,25 +1,87 @@
 #ifndef DATA_EXTRACT_HPP
 #define DATA_EXTRACT_HPP
 
+#include <cstddef>
 #include <vector>
 #include <string>
+#include <thread>
+#include "dataset.hpp"
+#include "normalizer.hpp"
 
-struct Record {
-    double pedal_length;
-    double pedal_width;
-    double sepal_length;
-    double sepal_width;
-    std::string flower_type;
-    double one_hot[3];
+// Dataset split into training and testing samples, the views point into data
+// The features are normalized with normalizer, which was fitted on the training samples only
+struct DataSplit {
+    Dataset data;
+    DatasetView training;
+    DatasetView testing;
+    Normalizer normalizer;
 };
 
-std::vector<std::vector<Record>> getCsvData();
-std::vector<std::vector<Record>> splitData(int trainNum, int testNum, Record* dataPoints);
-void shuffleVector(Record* dataPoints, int size);
+// Number of measurements on every line of an iris-style CSV, in file order sepal length, sepal width, petal length, petal width
+constexpr unsigned int IRIS_FEATURES = 4;
 
-double normalize_pedal_length(double value);
-double normalize_pedal_width(double value);
-double normalize_sepal_length(double value);
-double normalize_sepal_width(double value);
+// A line of the CSV that could not be turned into a sample
+struct CsvError {
+    // 1-based line number in the file
+    std::size_t line;
+    std::string message;
+};
+
+// Columnar samples parsed from one chunk of a CSV file
+struct CsvBlock {
+    // IRIS_FEATURES raw measurements per sample, row-major
+    std::vector<double> features;
+
+    // Class IDs indexing class_names, which lists the names in the order they first appear in the chunk
+    std::vector<unsigned int> labels;
+    std::vector<std::string> class_names;
+
+    // Details of the first MAX_REPORTED_ERRORS malformed lines, malformed_lines counts all of them
+    std::vector<CsvError> errors;
+    std::size_t malformed_lines = 0;
+
+    static constexpr std::size_t MAX_REPORTED_ERRORS = 100;
+};
+
+struct CsvParseResult {
+    // Samples in file order, class IDs follow the sorted class names
+    Dataset data;
+
+    std::vector<CsvError> errors;
+    std::size_t malformed_lines = 0;
+
+    // True when the data was mapped from the binary cache, the CSV was not parsed and errors is empty
+    bool from_cache = false;
+};
+
+// Parse the lines in [begin, end) of an iris-style CSV (four measurements then the class name) and append them to block
+// first_line is the line number of begin, the return value is the line number just past end
+// Blank lines are skipped, malformed lines are recorded in block and skipped
+std::size_t parseCsvChunk(const char* begin, const char* end, std::size_t first_line, CsvBlock& block);
+
+// Memory-map the file and parse it in newline-aligned chunks, throws std::runtime_error if it cannot be opened
+// With num_threads > 1 the chunks are parsed concurrently and merged in file order, so the result never depends on it
+CsvParseResult readCsvDataset(const std::string& path, unsigned int num_threads = 1);
+
+// Parse the CSV at csv_path and store it as a binary dataset file at dataset_path, see datasetFile.hpp
+CsvParseResult convertCsvToDatasetFile(const std::string& csv_path, const std::string& dataset_path, unsigned int num_threads = 1);
+
+// Where loadCsvDataset keeps the binary cache of a CSV file, next to it with a .bin suffix
+std::string datasetCachePath(const std::string& csv_path);
+
+// Load a CSV through its binary cache: the cache is mapped when it was built from the CSV as it is now (same size and
+// modification time), otherwise the CSV is parsed and the cache rebuilt. Failing to write the cache is not an error
+CsvParseResult loadCsvDataset(const std::string& csv_path, unsigned int num_threads = 1);
+
+// Read, shuffle and split the data 80 / 20 into training and testing sets, then normalize both with statistics of the
+// training set. Malformed lines are reported on stderr
+DataSplit getCsvData(const std::string& path = "data/iris.data", unsigned int num_threads = std::thread::hardware_concurrency(),
+                     NormalizationMethod method = NormalizationMethod::MinMax);
+
+// The first trainNum samples become the training set and the rest the testing set
+DataSplit splitData(Dataset data, std::size_t trainNum);
+
+// Shuffle with the fixed seed used for the train / test split
+void shuffleDataset(Dataset& data);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,118 @@
+#ifndef DATASET_HPP
+#define DATASET_HPP
+
+// Columnar container for labelled samples
+// Instead of one struct per sample the data is kept as separate contiguous blocks: a row-major samples x features
+// block of inputs, a samples x classes block of one-hot targets and an array of integer class IDs, with the class
+// names interned once. Feature and target rows of any range of samples are therefore already laid out as matrices,
+// so a batch is a pointer offset that goes straight into the matrix code instead of a gather into a new Matrix.
+
+#include <cstddef>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "matrix.hpp"
+
+class MappedFile;
+
+// Offset and scale of one feature, its normalized value is (raw - offset) / scale
+struct FeatureScaling {
+    double offset;
+    double scale;
+};
+
+// Read-only window onto consecutive samples of a Dataset, copying or slicing a view never copies any data
+// A view is only valid while the Dataset it was taken from is alive and unchanged
+class DatasetView {
+public:
+    DatasetView();
+
+    std::size_t size() const { return rows; }
+    bool empty() const { return rows == 0; }
+    unsigned int num_features() const { return feature_count; }
+    unsigned int num_classes() const { return class_count; }
+
+    // size() x num_features() inputs and size() x num_classes() one-hot targets
+    MatrixView features() const;
+    MatrixView targets() const;
+
+    const double* feature_row(std::size_t i) const { return feature_data + i * feature_count; }
+    const double* target_row(std::size_t i) const { return target_data + i * class_count; }
+    unsigned int label(std::size_t i) const { return label_data[i]; }
+    const unsigned int* labels() const { return label_data; }
+
+    // Samples [start, start + count) of this view
+    DatasetView slice(std::size_t start, std::size_t count) const;
+
+private:
+    friend class Dataset;
+
+    const double* feature_data;
+    const double* target_data;
+    const unsigned int* label_data;
+    std::size_t rows;
+    unsigned int feature_count;
+    unsigned int class_count;
+};
+
+class Dataset {
+public:
+    Dataset();
+
+    // Take ownership of row-major features (labels.size() x num_features) and class IDs indexing class_names
+    // The one-hot targets are built from the labels, throws if the sizes disagree or a label has no name
+    Dataset(unsigned int num_features, std::vector<double> features, std::vector<unsigned int> labels, std::vector<std::string> class_names);
+
+    // Use count samples of features and labels that live inside a memory-mapped file without copying them
+    // The dataset keeps the mapping alive, only the one-hot targets are built in memory
+    Dataset(unsigned int num_features, std::shared_ptr<const MappedFile> file, const double* features, const unsigned int* labels,
+            std::size_t count, std::vector<std::string> class_names);
+
+    // Views point into the storage, so a dataset can be moved but not copied
+    Dataset(Dataset&& other) noexcept;
+    Dataset& operator=(Dataset&& other) noexcept;
+    Dataset(const Dataset&) = delete;
+    Dataset& operator=(const Dataset&) = delete;
+
+    std::size_t size() const { return sample_count; }
+    bool empty() const { return sample_count == 0; }
+    unsigned int num_features() const { return feature_count; }
+    unsigned int num_classes() const { return static_cast<unsigned int>(class_names.size()); }
+
+    const std::string& class_name(unsigned int id) const { return class_names[id]; }
+    const std::vector<std::string>& get_class_names() const { return class_names; }
+
+    // Every sample, or samples [start, start + count)
+    DatasetView view() const;
+    DatasetView slice(std::size_t start, std::size_t count) const { return view().slice(start, count); }
+
+    // Reorder the samples with std::shuffle, i.e. the same permutation std::shuffle would apply to an array of samples
+    // A mapped dataset is copied into memory by this
+    void shuffle(std::mt19937& engine);
+
+    // Writable row-major features, a mapped dataset is first copied into memory
+    double* mutable_features();
+
+    // True while the features and labels are read straight from a mapped file
+    bool is_mapped() const { return mapping != nullptr; }
+
+private:
+    void build_targets();
+
+    unsigned int feature_count;
+    std::size_t sample_count;
+
+    // Point either into the owned vectors below or into the mapping
+    const double* feature_data;
+    const unsigned int* label_data;
+
+    std::vector<double> features;
+    std::vector<unsigned int> labels;
+    std::shared_ptr<const MappedFile> mapping;
+
+    std::vector<double> targets;
+    std::vector<std::string> class_names;
+};
+
+#endif
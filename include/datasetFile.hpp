@@ -0,0 +1,48 @@
+#ifndef DATASET_FILE_HPP
+#define DATASET_FILE_HPP
+
+// Versioned binary dataset files
+// A file holds the feature block, the class IDs and the class names, plus the size and modification time of the source
+// file it was built from. The numeric blocks are stored exactly as Dataset keeps them in memory and 64-byte aligned, so
+// loading a file maps it and points the Dataset straight at them instead of parsing anything.
+// Features are the raw measurements as doubles rather than pre-normalized floats: normalization is fitted on the
+// training split of each run (normalizer.hpp), so one cache serves every split and method, and the mapped block is
+// handed to Dataset as is, which keeps its features in doubles.
+
+#include <cstdint>
+#include <string>
+#include "dataset.hpp"
+
+// Bumped whenever the layout or the meaning of a block changes, files with another version are rejected
+// Version 3 drops the scaling block, which only ever held the identity once version 2 switched to raw measurements,
+// version 1 files held features normalized with fixed Iris constants
+constexpr std::uint32_t DATASET_FILE_VERSION = 3;
+
+// Identity of the source a dataset file was converted from, used to notice when the source has changed
+struct SourceStamp {
+    std::uint64_t size = 0;
+    std::int64_t modified = 0;
+
+    bool operator==(const SourceStamp& other) const { return size == other.size && modified == other.modified; }
+    bool operator!=(const SourceStamp& other) const { return !(*this == other); }
+};
+
+// Size and last write time of the file at path, throws std::runtime_error if it does not exist
+SourceStamp sourceStampOf(const std::string& path);
+
+struct LoadedDataset {
+    Dataset data;
+    SourceStamp source;
+};
+
+// Write data to path, the file is written next to it first and renamed into place so readers never see a partial file
+void writeDatasetFile(const std::string& path, const Dataset& data, const SourceStamp& source);
+
+// Map a dataset file, the returned Dataset reads its features and labels straight from the mapping
+// Throws std::runtime_error if the file is missing, truncated, from another version or otherwise inconsistent
+LoadedDataset loadDatasetFile(const std::string& path);
+
+// Only read the source stamp of a dataset file, returns false if it is missing or not a valid dataset file
+bool readDatasetFileStamp(const std::string& path, SourceStamp& source);
+
+#endif
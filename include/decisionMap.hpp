@@ -0,0 +1,91 @@
+#ifndef DECISION_MAP_HPP
+#define DECISION_MAP_HPP
+
+// Decision regions of a classifier over two of its inputs, the other inputs held at their mean
+// The map is an RGBA image whose pixels are evaluated on a grid in batches through the layer stack. A pass goes from
+// coarse to fine: the coarsest level evaluates one point per COARSEST_STEP x COARSEST_STEP tile and paints the whole
+// tile, every finer level halves the tile size and only evaluates the points the coarser levels have not, so a pass
+// costs one inference per pixel while the image is usable after the first few hundred. advance() takes a budget of
+// points, letting a render loop spread a pass over as many frames as it needs to keep its frame time.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "matrix.hpp"
+#include "layers.hpp"
+#include "dataset.hpp"
+
+class DecisionMap {
+public:
+    // Tile size of the first level of a pass, in pixels
+    static constexpr unsigned int COARSEST_STEP = 16;
+
+    // width x height pixels spanning the values of each input over samples with a margin of a tenth of the range on
+    // each side, held inputs at their mean over samples. Starts on inputs 0 and 1 with all parameters zero
+    // Throws std::invalid_argument if samples is empty, has another number of features than the network has inputs,
+    // or the network has fewer than two inputs
+    DecisionMap(const LayerStack& layers, const DatasetView& samples, unsigned int width, unsigned int height);
+
+    unsigned int width() const { return image_width; }
+    unsigned int height() const { return image_height; }
+
+    // RGBA, 4 bytes per pixel, rows from the top of the map (largest y value) down
+    const std::uint8_t* pixels() const { return image.data(); }
+
+    // Inputs on the horizontal and vertical axes, starts a new pass. Throws std::invalid_argument if they are equal
+    // or out of range
+    void set_axes(unsigned int feature_x, unsigned int feature_y);
+    unsigned int get_feature_x() const { return feature_x; }
+    unsigned int get_feature_y() const { return feature_y; }
+
+    // Range of an input covered by the map, in the units the network sees
+    double min_value(unsigned int feature) const { return lower[feature]; }
+    double max_value(unsigned int feature) const { return upper[feature]; }
+
+    // Start a new pass on a copy of parameters, a flat buffer laid out as the layer stack describes
+    // The current image stays until the new pass paints over it, so refreshing never flashes an empty map
+    void restart(const double* parameters);
+
+    // Evaluate up to max_points more grid points of the current pass, returns true if any pixel changed
+    bool advance(std::size_t max_points);
+
+    // True once every pixel of the current pass has been evaluated
+    bool complete() const { return level_step == 0; }
+
+    // RGB color of a class on the map, e.g. to draw samples over it
+    static void class_color(unsigned int c, std::uint8_t rgb[3]);
+
+private:
+    // Grid points of the current level and whether point i of it was already evaluated by a coarser level
+    unsigned int level_columns() const { return (image_width + level_step - 1) / level_step; }
+    unsigned int level_rows() const { return (image_height + level_step - 1) / level_step; }
+    bool evaluated_before(unsigned int x, unsigned int y) const;
+
+    // Run the queued points through the network and paint their tiles
+    void evaluate_batch();
+
+    const LayerStack& layers;
+    unsigned int image_width;
+    unsigned int image_height;
+    std::vector<std::uint8_t> image;
+
+    unsigned int feature_x;
+    unsigned int feature_y;
+    std::vector<double> lower;
+    std::vector<double> upper;
+    std::vector<double> means;
+
+    Matrix parameters;
+
+    // Position of the pass: the tile size of the current level (0 once the pass is complete) and the next grid point
+    unsigned int level_step;
+    std::size_t next_point;
+
+    // Inputs of the queued points, one row each, the pixel of each and the workspace of the batch
+    Matrix batch;
+    std::vector<unsigned int> batch_pixels;
+    unsigned int batch_rows;
+    InferenceWorkspace ws;
+};
+
+#endif
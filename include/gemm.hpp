@@ -0,0 +1,30 @@
+#ifndef GEMM_HPP
+#define GEMM_HPP
+
+// Cache-blocked general matrix multiply on raw row-major buffers
+// Computes C = alpha * op(A) * op(B) + beta * C where op(X) is X or its transpose, so callers never need to
+// materialize a transposed copy. op(A) is m x k, op(B) is k x n and C is m x n, ld* are the row strides
+
+enum class GemmKernel {
+    Scalar,
+    AVX2,
+    AVX512
+};
+
+void gemm(bool transpose_a, bool transpose_b,
+          unsigned int m, unsigned int n, unsigned int k,
+          double alpha, const double* a, unsigned int lda,
+          const double* b, unsigned int ldb,
+          double beta, double* c, unsigned int ldc);
+
+// The micro-kernel in use, picked on first use from what the CPU supports
+// Setting the IRIS_GEMM_KERNEL environment variable to scalar, avx2 or avx512 overrides the choice
+GemmKernel active_gemm_kernel();
+
+// Force a specific micro-kernel, mainly for benchmarks, returns false if the CPU or build cannot run it
+bool set_gemm_kernel(GemmKernel kernel);
+
+bool gemm_kernel_supported(GemmKernel kernel);
+const char* gemm_kernel_name(GemmKernel kernel);
+
+#endif
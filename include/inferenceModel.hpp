@@ -0,0 +1,163 @@
+#ifndef INFERENCE_MODEL_HPP
+#define INFERENCE_MODEL_HPP
+
+// Frozen, serving-only copy of a trained NeuralNetwork
+// The layer sizes are template parameters, so every loop below has compile-time bounds and the compiler fully unrolls
+// the small Iris shape into straight-line, register-resident code. Weights are packed as float32, or as int8 with one
+// float scale per output unit when WeightFormat::Int8 is chosen. The model is immutable after compile(), so it can be
+// shared between any number of threads without synchronization.
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include "neuralNetwork.hpp"
+
+enum class WeightFormat {
+    Float32,
+    Int8
+};
+
+// Storage for a dense Rows x Cols weight matrix in the chosen format
+template <unsigned int Rows, unsigned int Cols, WeightFormat Format>
+struct PackedWeights;
+
+template <unsigned int Rows, unsigned int Cols>
+struct PackedWeights<Rows, Cols, WeightFormat::Float32> {
+    alignas(64) float values[Rows][Cols];
+
+    void pack(const MatrixView& weights){
+        for(unsigned int i = 0; i < Rows; i++){
+            for(unsigned int j = 0; j < Cols; j++){
+                values[i][j] = static_cast<float>(weights.get_val(i, j));
+            }
+        }
+    }
+
+    float weight(unsigned int i, unsigned int j) const { return values[i][j]; }
+    float column_scale(unsigned int) const { return 1.0f; }
+};
+
+// Symmetric per-column quantization, weight(i, j) is q[i][j] * scale[j]
+template <unsigned int Rows, unsigned int Cols>
+struct PackedWeights<Rows, Cols, WeightFormat::Int8> {
+    alignas(64) std::int8_t values[Rows][Cols];
+    float scales[Cols];
+
+    void pack(const MatrixView& weights){
+        for(unsigned int j = 0; j < Cols; j++){
+            double largest = 0.0;
+            for(unsigned int i = 0; i < Rows; i++){
+                largest = std::max(largest, std::fabs(weights.get_val(i, j)));
+            }
+
+            double scale = largest > 0.0 ? largest / 127.0 : 1.0;
+            scales[j] = static_cast<float>(scale);
+            for(unsigned int i = 0; i < Rows; i++){
+                long q = std::lround(weights.get_val(i, j) / scale);
+                values[i][j] = static_cast<std::int8_t>(std::max(-127L, std::min(127L, q)));
+            }
+        }
+    }
+
+    // The scale is applied once per output after the sum instead of once per weight
+    float weight(unsigned int i, unsigned int j) const { return static_cast<float>(values[i][j]); }
+    float column_scale(unsigned int j) const { return scales[j]; }
+};
+
+template <unsigned int Inputs, unsigned int Hidden, unsigned int Outputs, WeightFormat Format = WeightFormat::Float32>
+class InferenceModel {
+public:
+    struct Prediction {
+        // Index of the winning class
+        unsigned int label;
+
+        // Output activations normalized to sum to one
+        std::array<float, Outputs> probabilities;
+    };
+
+    // Pack the weights of a trained network, throws if it is not two sigmoid layers of the template parameters' sizes
+    static InferenceModel compile(const NeuralNetwork& network){
+        const std::vector<DenseLayerSpec>& layers = network.get_layers().get_spec().layers();
+        if(layers.size() != 2 || layers[0].activation != Activation::Sigmoid || layers[1].activation != Activation::Sigmoid){
+            throw std::invalid_argument("The inference model only holds two sigmoid layers");
+        }
+
+        MatrixView W1 = network.weights(0);
+        MatrixView W2 = network.weights(1);
+        MatrixView b1 = network.bias(0);
+        MatrixView b2 = network.bias(1);
+
+        if(W1.get_num_rows() != Inputs || W1.get_num_col() != Hidden || W2.get_num_rows() != Hidden || W2.get_num_col() != Outputs){
+            throw std::invalid_argument("Network layer sizes do not match the inference model");
+        }
+
+        InferenceModel model;
+        model.w1.pack(W1);
+        model.w2.pack(W2);
+        for(unsigned int j = 0; j < Hidden; j++) model.b1[j] = static_cast<float>(b1.get_val(0, j));
+        for(unsigned int j = 0; j < Outputs; j++) model.b2[j] = static_cast<float>(b2.get_val(0, j));
+        return model;
+    }
+
+    // Classify a single sample of Inputs features
+    Prediction classify(const float* features) const {
+        float hidden[Hidden];
+        for(unsigned int j = 0; j < Hidden; j++){
+            float sum = 0.0f;
+            for(unsigned int i = 0; i < Inputs; i++){
+                sum += features[i] * w1.weight(i, j);
+            }
+            hidden[j] = sigmoid(sum * w1.column_scale(j) + b1[j]);
+        }
+
+        Prediction result;
+        float total = 0.0f;
+        for(unsigned int j = 0; j < Outputs; j++){
+            float sum = 0.0f;
+            for(unsigned int i = 0; i < Hidden; i++){
+                sum += hidden[i] * w2.weight(i, j);
+            }
+            result.probabilities[j] = sigmoid(sum * w2.column_scale(j) + b2[j]);
+            total += result.probabilities[j];
+        }
+
+        result.label = 0;
+        for(unsigned int j = 1; j < Outputs; j++){
+            if(result.probabilities[j] > result.probabilities[result.label]){
+                result.label = j;
+            }
+        }
+        for(unsigned int j = 0; j < Outputs; j++){
+            result.probabilities[j] /= total;
+        }
+
+        return result;
+    }
+
+    // Classify count samples stored back to back, Inputs features each
+    void classify_batch(const float* features, std::size_t count, Prediction* out) const {
+        for(std::size_t n = 0; n < count; n++){
+            out[n] = classify(features + n * Inputs);
+        }
+    }
+
+private:
+    static float sigmoid(float x){
+        return 1.0f / (1.0f + std::exp(-x));
+    }
+
+    PackedWeights<Inputs, Hidden, Format> w1;
+    PackedWeights<Hidden, Outputs, Format> w2;
+    float b1[Hidden];
+    float b2[Outputs];
+};
+
+// The 4-5-3 network used for the Iris data
+using IrisInferenceModel = InferenceModel<4, 5, 3>;
+using IrisInferenceModelInt8 = InferenceModel<4, 5, 3, WeightFormat::Int8>;
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef LAYERS_HPP
+#define LAYERS_HPP
+
+// Layer stack of dense layers with an activation each and a loss on the output
+// All weights and biases of a stack live in one flat parameter buffer, each tensor starting on a cache line, and
+// gradients use the same layout so updating, reducing or saving every parameter is a single loop over one buffer.
+// The pre-activations, activations and back propagated errors of a batch likewise live in one arena per workspace,
+// laid out once for a batch size and reused afterwards, so deeper models do not add an allocation per layer.
+
+#include <cstddef>
+#include <vector>
+#include "matrix.hpp"
+#include "activations.hpp"
+
+enum class Loss {
+    // Half the summed squared error, the cost the original network reported
+    // Like the original network the output error a - y is propagated as is, without the output activation's derivative
+    MeanSquaredError,
+
+    // Cross-entropy of a softmax output layer, fused with the softmax: the cost comes straight from the pre-activations
+    // through log-sum-exp, so it never takes the log of a rounded probability, and the output error is exactly a - y
+    CrossEntropy
+};
+
+struct DenseLayerSpec {
+    unsigned int units;
+    Activation activation;
+};
+
+// Description of a network, built up layer by layer, e.g.
+// NetworkSpec(4).dense(5).activation(Activation::Sigmoid).dense(3).activation(Activation::Sigmoid)
+class NetworkSpec {
+public:
+    explicit NetworkSpec(unsigned int inputs);
+
+    // Append a fully connected layer of the given width, without an activation until activation() is called
+    NetworkSpec& dense(unsigned int units);
+
+    // Set the activation of the last dense layer, throws std::logic_error if there is none or it already has one
+    NetworkSpec& activation(Activation activation);
+
+    NetworkSpec& loss(Loss loss);
+
+    // The original Iris network: one sigmoid hidden layer and a sigmoid output layer trained on squared error
+    static NetworkSpec two_layer(unsigned int inputs, unsigned int hidden, unsigned int outputs);
+
+    // The same shape as a classifier: a sigmoid hidden layer and a softmax output trained on cross-entropy
+    static NetworkSpec softmax_classifier(unsigned int inputs, unsigned int hidden, unsigned int outputs);
+
+    unsigned int input_size() const { return inputs; }
+    unsigned int output_size() const { return layer_specs.empty() ? inputs : layer_specs.back().units; }
+    const std::vector<DenseLayerSpec>& layers() const { return layer_specs; }
+    Loss get_loss() const { return loss_function; }
+
+private:
+    unsigned int inputs;
+    std::vector<DenseLayerSpec> layer_specs;
+    Loss loss_function;
+};
+
+// Activations of one forward pass, owned by the caller so any number of threads can run inference on the same
+// network at once, each with its own workspace
+// The arena is laid out on first use for a batch size and only reallocated when a larger batch comes along
+struct InferenceWorkspace {
+    // Output of layer l before and after its activation, rows x units of that layer
+    MatrixView pre_activations(unsigned int layer) const { return view(z_offsets[layer], layer); }
+    MatrixView activations(unsigned int layer) const { return view(a_offsets[layer], layer); }
+    MatrixView output() const { return activations(static_cast<unsigned int>(widths.size() - 1)); }
+
+    // One block holding every layer's pre-activations and activations, plus the back propagation errors when training
+    Matrix arena;
+    unsigned int rows = 0;
+    bool with_errors = false;
+    std::vector<unsigned int> widths;
+    std::vector<std::size_t> z_offsets;
+    std::vector<std::size_t> a_offsets;
+    std::size_t error_offsets[2] = {0, 0};
+
+private:
+    MatrixView view(std::size_t offset, unsigned int layer) const { return MatrixView(arena.data() + offset, rows, widths[layer]); }
+};
+
+// Forward caches and back propagation scratch for one stream of batches
+// The network keeps one for its own forward/back propagation calls and one per worker when training in parallel
+struct TrainingWorkspace : InferenceWorkspace {
+    TrainingWorkspace() { with_errors = true; }
+
+    // Input of the last forward_propagation call, the other forward caches are used by back propagation
+    Matrix input_cache;
+
+    // Gradients of every parameter in the stack's flat layout, sized on the first training step and reused afterwards
+    Matrix gradients;
+};
+
+// A NetworkSpec checked and turned into the layout of its parameters and activations
+// The stack itself holds no weights, it runs the layers on whatever parameter buffer it is given, so a network's
+// own weights and a memory-mapped model file share the same forward pass
+class LayerStack {
+public:
+    // Throws std::invalid_argument if the spec has no layers, a layer of width zero, or softmax anywhere but on the
+    // output layer of a cross-entropy network
+    explicit LayerStack(const NetworkSpec& spec);
+
+    const NetworkSpec& get_spec() const { return spec; }
+    unsigned int num_layers() const { return static_cast<unsigned int>(spec.layers().size()); }
+    unsigned int input_size() const { return spec.input_size(); }
+    unsigned int output_size() const { return spec.output_size(); }
+    unsigned int layer_inputs(unsigned int layer) const { return layer == 0 ? spec.input_size() : spec.layers()[layer - 1].units; }
+
+    // Number of doubles in a parameter or gradient buffer, including the padding that aligns each tensor
+    std::size_t parameter_count() const { return total_parameters; }
+
+    // Views of one layer's weights (inputs x units) and bias (1 x units) inside a flat parameter or gradient buffer
+    MatrixView weights(const double* parameters, unsigned int layer) const;
+    MatrixView bias(const double* parameters, unsigned int layer) const;
+
+    // Positions of one layer's weights and bias in the flat buffer, in doubles from its start
+    std::size_t weight_offset(unsigned int layer) const { return weight_offsets[layer]; }
+    std::size_t bias_offset(unsigned int layer) const { return bias_offsets[layer]; }
+
+    // Lay the arena of ws out for a batch of rows samples, a no-op when it already is
+    // Training workspaces also get room for the back propagated errors
+    void prepare(InferenceWorkspace& ws, unsigned int rows) const;
+
+    // Run the batch through every layer, leaving each layer's pre-activations and activations in ws
+    void forward(const MatrixView& input, const double* parameters, InferenceWorkspace& ws) const;
+
+    // Back propagation from the caches of the last forward pass in ws
+    // ws.gradients receives the per-sample gradients summed over the batch times scale
+    void backward(const MatrixView& input, const MatrixView& expected_output, const double* parameters, TrainingWorkspace& ws, double scale) const;
+
+    // Cost of the last forward pass in ws against the expected outputs, summed over the samples
+    double loss(const InferenceWorkspace& ws, const MatrixView& expected_output) const;
+
+private:
+    NetworkSpec spec;
+    std::vector<std::size_t> weight_offsets;
+    std::vector<std::size_t> bias_offsets;
+    std::size_t total_parameters;
+    unsigned int widest_layer;
+};
+
+double mean_squared_error(const MatrixView& prediction, const MatrixView& actual);
+
+// Summed cross-entropy of the softmax of each row of logits against the expected distributions in actual
+double softmax_cross_entropy(const MatrixView& logits, const MatrixView& actual);
+
+#endif
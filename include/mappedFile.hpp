@@ -0,0 +1,37 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file, the contents are paged in by the OS as they are touched
+class MappedFile {
+public:
+    // Map the file at path, throws std::runtime_error if it cannot be opened or mapped
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // An empty file maps to a null pointer with size zero
+    const char* data() const { return view; }
+    std::size_t size() const { return length; }
+
+    // Tell the OS the mapping will be read front to back so it can read ahead aggressively
+    void advise_sequential() const;
+
+private:
+    void release();
+
+    const char* view;
+    std::size_t length;
+#if defined(_WIN32)
+    void* file_handle;
+    void* mapping_handle;
+#endif
+};
+
+#endif
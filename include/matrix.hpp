@@ -1,45 +1,214 @@
 #ifndef MATRIX_H
 #define MATRIX_H
 
-#include <vector>
+#include <cstddef>
+#include <memory>
+#include <new>
 #include <random>
 #include <stdexcept>
+#include "matrixExpr.hpp"
+#include "profiler.hpp"
 
-class Matrix {
+class Matrix;
+struct GemmOperand;
+
+// Read-only, non-owning view of a contiguous row-major block of doubles, e.g. a batch of rows inside a Dataset
+// Any Matrix converts to a view of itself, so functions taking a MatrixView accept both without copying
+class MatrixView : public MatrixExpr<MatrixView> {
 public:
+    MatrixView() : values(nullptr), num_rows(0), num_col(0) {}
+    MatrixView(const double* values, unsigned int rows, unsigned int col) : values(values), num_rows(rows), num_col(col) {}
+    MatrixView(const Matrix& matrix);
+
+    unsigned int get_num_rows() const { return num_rows; }
+    unsigned int get_num_col() const { return num_col; }
+    double get_val(unsigned int row, unsigned int col) const { return values[static_cast<std::size_t>(row) * num_col + col]; }
+
+    const double* data() const { return values; }
+    const double* row(unsigned int r) const { return values + static_cast<std::size_t>(r) * num_col; }
+    unsigned int get_stride() const { return num_col; }
+    std::size_t size() const { return static_cast<std::size_t>(num_rows) * num_col; }
+    double eval(std::size_t index) const { return values[index]; }
+
+    GemmOperand transposed() const;
+
+private:
+    const double* values;
+    unsigned int num_rows;
+    unsigned int num_col;
+};
+
+// A matrix used as one side of a product, optionally transposed on the fly without copying it
+struct GemmOperand {
+    GemmOperand(const MatrixView& matrix) : matrix(matrix), transposed(false) {}
+    GemmOperand(const Matrix& matrix) : matrix(matrix), transposed(false) {}
+    GemmOperand(const MatrixView& matrix, bool transposed) : matrix(matrix), transposed(transposed) {}
+
+    MatrixView matrix;
+    bool transposed;
+};
+
+inline GemmOperand MatrixView::transposed() const {
+    return GemmOperand(*this, true);
+}
+
+class Matrix : public MatrixExpr<Matrix> {
+public:
+    // Alignment of the backing buffer in bytes, wide enough for a full cache line / AVX-512 register
+    static constexpr std::size_t ALIGNMENT = 64;
+
+    // Zero-filled rows x col matrix
     Matrix(unsigned int rows, unsigned int col);
 
     Matrix();
 
-    Matrix(unsigned int rows, unsigned int col, double fill_value)
-    : num_rows(rows), num_col(col), engine(42), dist(0.0, 0.1) {
-    arr2D = std::vector<std::vector<double>>(rows, std::vector<double>(col, fill_value));
-}
-    
+    Matrix(unsigned int rows, unsigned int col, double fill_value);
+
+    // Matrix whose contents are left unspecified, for results that are about to be fully overwritten
+    static Matrix uninitialized(unsigned int rows, unsigned int col);
+
+    // Matrix filled with values drawn uniformly from [low, high) using the caller's engine
+    static Matrix random(unsigned int rows, unsigned int col, std::mt19937& engine, double low = 0.0, double high = 0.1);
+
+    Matrix(const Matrix& other);
+    Matrix(Matrix&& other) noexcept;
+    Matrix& operator=(const Matrix& other);
+    Matrix& operator=(Matrix&& other) noexcept;
+
+    // Evaluate an elementwise expression in a single pass, writing straight into this matrix
+    template <typename E>
+    Matrix(const MatrixExpr<E>& expr);
+    template <typename E>
+    Matrix& operator=(const MatrixExpr<E>& expr);
+
     unsigned int get_num_rows() const;
     unsigned int get_num_col() const;
     double get_val(unsigned int row, unsigned int col) const;
     void set_val(unsigned int row, unsigned int col, double value);
-    
+
+    // Raw access to the contiguous row-major buffer, element (i, j) lives at data()[i * get_stride() + j]
+    double* data() { return buffer.get(); }
+    const double* data() const { return buffer.get(); }
+    double* row(unsigned int r) { return buffer.get() + static_cast<std::size_t>(r) * num_col; }
+    const double* row(unsigned int r) const { return buffer.get() + static_cast<std::size_t>(r) * num_col; }
+    unsigned int get_stride() const { return num_col; }
+
+    // Reshape to rows x col, the old buffer is reused whenever it is already big enough and the contents are left unspecified
+    void resize(unsigned int rows, unsigned int col);
+    std::size_t size() const { return static_cast<std::size_t>(num_rows) * num_col; }
+
+    // Entry lookup used when this matrix is an operand of an expression
+    double eval(std::size_t index) const { return buffer[index]; }
+
     Matrix operator*(const Matrix& other) const;
 
 
     Matrix transpose() const;
-    Matrix operator+(const Matrix& other) const;
-    Matrix operator-(const Matrix& other) const;
-    Matrix elementwise_multiply(const Matrix& other) const;
-    Matrix operator*(double scalar) const;
-    Matrix apply_function(double (*func)(double)) const;
+
+    // Write the transpose into out, reusing out's buffer
+    void transpose_into(Matrix& out) const;
+
+    // Use this matrix transposed inside a product, e.g. a.transposed() * b, without materializing the transpose
+    GemmOperand transposed() const { return GemmOperand(*this, true); }
+
+    // In-place elementwise updates, these never allocate
+    template <typename E>
+    Matrix& operator+=(const MatrixExpr<E>& expr);
+    template <typename E>
+    Matrix& operator-=(const MatrixExpr<E>& expr);
+    Matrix& operator*=(double scalar);
+
+    // this -= scale * other, the axpy-style update used for gradient descent steps
+    void sub_scaled(const Matrix& other, double scale);
 
 private:
+    // Releases buffers obtained with the aligned form of operator new
+    struct AlignedDelete {
+        void operator()(double* ptr) const { ::operator delete(ptr, std::align_val_t(ALIGNMENT)); }
+    };
+
     unsigned int num_rows;
     unsigned int num_col;
-    std::vector<std::vector<double>> arr2D;
-    std::mt19937 engine;
-    std::uniform_real_distribution<double> dist;
-    
-    double gen_rand();
-    void randomize_matrix();
+    std::size_t capacity;
+    std::unique_ptr<double[], AlignedDelete> buffer;
+
 };
 
-#endif
\ No newline at end of file
+// Fill every entry of the matrix with values drawn uniformly from [low, high) using the given engine
+void randomize_matrix(Matrix& matrix, std::mt19937& engine, double low = 0.0, double high = 0.1);
+
+// Fused dense layer: computes func(input * weights + bias) in one pass over the output without any temporaries
+// bias is either a single row added to every row of the product or a matrix of the product's shape
+// When pre_activation is given it also receives input * weights + bias, which back propagation needs
+Matrix linear_activation(const MatrixView& input, const MatrixView& weights, const MatrixView& bias, double (*func)(double), Matrix* pre_activation = nullptr);
+
+// Same as linear_activation but writes into caller-owned matrices, which are only reallocated when they are too small
+void linear_activation_into(const MatrixView& input, const MatrixView& weights, const MatrixView& bias, double (*func)(double), Matrix& out, Matrix* pre_activation = nullptr);
+
+// out = alpha * (a * b) + beta * out, written into out's existing storage, either side may be a.transposed()
+// With beta == 0 out is resized as needed and its old contents are ignored, otherwise it must already be the right shape
+// out must not overlap a or b, not even through a view of some of its rows, throws std::invalid_argument if it does
+void gemm_into(const GemmOperand& a, const GemmOperand& b, Matrix& out, double alpha = 1.0, double beta = 0.0);
+
+// out = scale * (sum of the rows of m), a 1 x cols row vector, e.g. the bias gradient of a batch
+void column_sums_into(const Matrix& m, Matrix& out, double scale = 1.0);
+
+// Matrix product where at least one side is transposed on the fly
+Matrix operator*(const GemmOperand& a, const GemmOperand& b);
+
+// Matrix product where either side is an unevaluated expression, the expression is materialized first
+template <typename L, typename R>
+Matrix operator*(const MatrixExpr<L>& a, const MatrixExpr<R>& b){
+    return Matrix(a) * Matrix(b);
+}
+
+inline MatrixView::MatrixView(const Matrix& matrix)
+    : values(matrix.data()), num_rows(matrix.get_num_rows()), num_col(matrix.get_num_col()) {
+}
+
+template <typename E>
+Matrix::Matrix(const MatrixExpr<E>& expr)
+    : num_rows(0), num_col(0), capacity(0) {
+    IRIS_PROFILE_COUNT(ProfileCounter::MatrixConstructions, 1);
+    *this = expr;
+}
+
+// Every expression node is elementwise, so entry i only ever reads entry i of its operands
+// That makes it safe to assign an expression back into one of its own operands, e.g. W = W - dW * rate
+template <typename E>
+Matrix& Matrix::operator=(const MatrixExpr<E>& expr){
+    const E& e = expr.self();
+    resize(e.get_num_rows(), e.get_num_col());
+
+    double* out = buffer.get();
+    for(std::size_t i{}; i < size(); i++){
+        out[i] = e.eval(i);
+    }
+    return *this;
+}
+
+template <typename E>
+Matrix& Matrix::operator+=(const MatrixExpr<E>& expr){
+    check_same_shape(*this, expr, "Matrix dimensions do not match for addition");
+    const E& e = expr.self();
+
+    double* out = buffer.get();
+    for(std::size_t i{}; i < size(); i++){
+        out[i] += e.eval(i);
+    }
+    return *this;
+}
+
+template <typename E>
+Matrix& Matrix::operator-=(const MatrixExpr<E>& expr){
+    check_same_shape(*this, expr, "Matrix dimensions do not match for subtraction");
+    const E& e = expr.self();
+
+    double* out = buffer.get();
+    for(std::size_t i{}; i < size(); i++){
+        out[i] -= e.eval(i);
+    }
+    return *this;
+}
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef MATRIX_EXPR_HPP
+#define MATRIX_EXPR_HPP
+
+// Lazy expression templates for elementwise Matrix arithmetic
+// Operators such as +, -, scalar * and elementwise_multiply build a small tree of these nodes instead of a new Matrix,
+// and the whole tree is evaluated in a single pass once it is assigned to a Matrix
+// Nodes keep references to the Matrix operands, so an expression has to be assigned in the same statement it is built in
+
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+
+class Matrix;
+
+// Base class for anything that can be evaluated entry by entry, E is the concrete node type
+template <typename E>
+class MatrixExpr {
+public:
+    const E& self() const { return static_cast<const E&>(*this); }
+
+    // Multiply each entry (i, j) by the equivalent entry of other
+    template <typename R>
+    auto elementwise_multiply(const MatrixExpr<R>& other) const;
+
+    // Apply a function to each entry
+    auto apply_function(double (*func)(double)) const;
+};
+
+// Matrix operands are held by reference, nested expression nodes are small and held by value
+template <typename E>
+struct MatrixExprOperand { using type = const E; };
+
+template <>
+struct MatrixExprOperand<Matrix> { using type = const Matrix&; };
+
+// Node combining two operands of the same shape
+template <typename L, typename R, typename Op>
+class MatrixBinaryExpr : public MatrixExpr<MatrixBinaryExpr<L, R, Op>> {
+public:
+    MatrixBinaryExpr(const L& lhs, const R& rhs, Op op) : lhs(lhs), rhs(rhs), op(op) {}
+
+    unsigned int get_num_rows() const { return lhs.get_num_rows(); }
+    unsigned int get_num_col() const { return lhs.get_num_col(); }
+    double eval(std::size_t index) const { return op(lhs.eval(index), rhs.eval(index)); }
+
+private:
+    typename MatrixExprOperand<L>::type lhs;
+    typename MatrixExprOperand<R>::type rhs;
+    Op op;
+};
+
+// Node transforming every entry of a single operand
+template <typename E, typename Op>
+class MatrixUnaryExpr : public MatrixExpr<MatrixUnaryExpr<E, Op>> {
+public:
+    MatrixUnaryExpr(const E& operand, Op op) : operand(operand), op(op) {}
+
+    unsigned int get_num_rows() const { return operand.get_num_rows(); }
+    unsigned int get_num_col() const { return operand.get_num_col(); }
+    double eval(std::size_t index) const { return op(operand.eval(index)); }
+
+private:
+    typename MatrixExprOperand<E>::type operand;
+    Op op;
+};
+
+struct AddOp {
+    double operator()(double a, double b) const { return a + b; }
+};
+
+struct SubtractOp {
+    double operator()(double a, double b) const { return a - b; }
+};
+
+struct MultiplyOp {
+    double operator()(double a, double b) const { return a * b; }
+};
+
+struct ScaleOp {
+    double scalar;
+    double operator()(double a) const { return a * scalar; }
+};
+
+struct ScalarSubtractOp {
+    double scalar;
+    double operator()(double a) const { return scalar - a; }
+};
+
+struct FunctionOp {
+    double (*func)(double);
+    double operator()(double a) const { return func(a); }
+};
+
+template <typename L, typename R>
+void check_same_shape(const MatrixExpr<L>& a, const MatrixExpr<R>& b, const char* message){
+    if(a.self().get_num_rows() != b.self().get_num_rows() || a.self().get_num_col() != b.self().get_num_col()){
+        throw std::invalid_argument(message);
+    }
+}
+
+// Returns the result of adding up two matrices
+template <typename L, typename R>
+MatrixBinaryExpr<L, R, AddOp> operator+(const MatrixExpr<L>& a, const MatrixExpr<R>& b){
+    check_same_shape(a, b, "Matrix dimensions do not match for addition");
+    return MatrixBinaryExpr<L, R, AddOp>(a.self(), b.self(), AddOp{});
+}
+
+template <typename L, typename R>
+MatrixBinaryExpr<L, R, SubtractOp> operator-(const MatrixExpr<L>& a, const MatrixExpr<R>& b){
+    check_same_shape(a, b, "Matrix dimensions do not match for subtraction");
+    return MatrixBinaryExpr<L, R, SubtractOp>(a.self(), b.self(), SubtractOp{});
+}
+
+// Multiply each entry in the matrix by the same scalar value
+template <typename E>
+MatrixUnaryExpr<E, ScaleOp> operator*(const MatrixExpr<E>& a, double scalar){
+    return MatrixUnaryExpr<E, ScaleOp>(a.self(), ScaleOp{scalar});
+}
+
+template <typename E>
+MatrixUnaryExpr<E, ScaleOp> operator*(double scalar, const MatrixExpr<E>& a){
+    return MatrixUnaryExpr<E, ScaleOp>(a.self(), ScaleOp{scalar});
+}
+
+// Subtract each entry from the same scalar value, e.g. 1.0 - A for the sigmoid derivative
+template <typename E>
+MatrixUnaryExpr<E, ScalarSubtractOp> operator-(double scalar, const MatrixExpr<E>& a){
+    return MatrixUnaryExpr<E, ScalarSubtractOp>(a.self(), ScalarSubtractOp{scalar});
+}
+
+template <typename E>
+template <typename R>
+auto MatrixExpr<E>::elementwise_multiply(const MatrixExpr<R>& other) const {
+    check_same_shape(*this, other, "Matrix dimesions do not match for multiplication");
+    return MatrixBinaryExpr<E, R, MultiplyOp>(self(), other.self(), MultiplyOp{});
+}
+
+template <typename E>
+auto MatrixExpr<E>::apply_function(double (*func)(double)) const {
+    return MatrixUnaryExpr<E, FunctionOp>(self(), FunctionOp{func});
+}
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef MODEL_FILE_HPP
+#define MODEL_FILE_HPP
+
+// Versioned binary model files, used both for saved models and for training checkpoints
+// A file holds the layer table of the network, the number of epochs trained so far, the normalization the network was
+// trained with, the optimizer and its state, and the flat parameter buffer exactly as LayerStack lays it out in memory,
+// 64-byte aligned, so a mapped file can be used for inference in place, without parsing or copying the weights.
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "matrix.hpp"
+#include "dataset.hpp"
+#include "normalizer.hpp"
+#include "layers.hpp"
+#include "optimizer.hpp"
+
+class MappedFile;
+
+// Bumped whenever the layout or the meaning of a block changes, files with another version are rejected
+// Version 2 stores a layer table and the flat parameter buffer, version 1 files held a fixed W1, b1, W2, b2
+// Version 3 adds the optimizer settings and state
+constexpr std::uint32_t MODEL_FILE_VERSION = 3;
+
+// Write a network to path, parameters being a buffer of layers.parameter_count() doubles and scaling either empty
+// or one entry per input. The file is written next to path first and renamed into place so an interrupted write
+// never leaves a partial model behind. Throws std::invalid_argument if the scaling or optimizer state does not fit the network
+void writeModelFile(const std::string& path, const LayerStack& layers, const double* parameters,
+                    const std::vector<FeatureScaling>& scaling, std::uint64_t epochs_completed, const Optimizer& optimizer);
+
+// Read-only model served straight from a mapped model file
+// Opening one only maps the file and checks its header, the weights are paged in on first use and never copied.
+// Like NeuralNetwork::predict_batch it is safe to share between threads as long as each has its own workspace
+class MappedModel {
+public:
+    // Throws std::runtime_error if the file is missing, truncated, from another version or otherwise inconsistent
+    explicit MappedModel(const std::string& path);
+
+    const LayerStack& get_layers() const { return layers; }
+    const Normalizer& get_normalizer() const { return normalizer; }
+    std::uint64_t epochs_completed() const { return epochs; }
+
+    // Copy of the optimizer the network was trained with, its state included, for resuming training
+    Optimizer optimizer() const;
+
+    // The flat parameter buffer inside the mapping, and views of one layer's weights and bias
+    const double* parameters() const { return values; }
+    MatrixView weights(unsigned int layer) const { return layers.weights(values, layer); }
+    MatrixView bias(unsigned int layer) const { return layers.bias(values, layer); }
+
+    // Inference on a batch of already normalized inputs (one sample per row), the output is ws.output()
+    MatrixView predict_batch(const MatrixView& input, InferenceWorkspace& ws) const;
+
+private:
+    std::shared_ptr<const MappedFile> file;
+    LayerStack layers;
+    const double* values;
+    Normalizer normalizer;
+    std::uint64_t epochs;
+    OptimizerSpec optimizer_spec;
+    std::uint64_t optimizer_steps;
+    const double* optimizer_values;
+    std::uint64_t optimizer_count;
+};
+
+#endif
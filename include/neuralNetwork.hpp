@@ -1,69 +1,163 @@
 #ifndef neuralNetwork_HPP
 #define neuralNetwork_HPP
 
+#include <cstdint>
+#include <memory>
+#include <string>
 #include <vector>
 #include "matrix.hpp"
-#include "dataExtract.hpp"
-
-struct GradientStruct {
-    Matrix dW1;
-    Matrix dW2;
-    Matrix db1;  
-    Matrix db2;
-};
+#include "layers.hpp"
+#include "dataset.hpp"
+#include "normalizer.hpp"
+#include "optimizer.hpp"
+#include "threadPool.hpp"
 
 class NeuralNetwork {
     public:
 
-        // Constructor for the neural network
-        NeuralNetwork(unsigned int inputNum, unsigned int outputNum, unsigned int HiddenLayerNum);
+        // Network with the layer stack described by spec, throws std::invalid_argument if the spec has no layers
+        explicit NeuralNetwork(const NetworkSpec& spec);
+
+        // Constructor for the neural network, the original shape of one sigmoid hidden layer, see NetworkSpec::two_layer
+        NeuralNetwork(unsigned int inputNum, unsigned int HiddenLayerNum, unsigned int outputNum);
 
         // Default constructor for the neural network, initializes the network with 4 input nodes, 5 hidden layer nodes, and 3 output nodes
         NeuralNetwork();
 
-        // Forward propagation function that takes in an input vector and returns the output of the network as a vector of doubles
-        Matrix forward_propagation(const Matrix& input);
+        // Forward propagation function that takes in a batch of inputs (one sample per row) and returns the output of the network
+        // The returned view points into the network's workspace and is overwritten by the next forward pass
+        // This is the training path and keeps the caches back_propagation needs, use predict/predict_batch for inference
+        MatrixView forward_propagation(const Matrix& input);
 
-        // Back propagation function that will return a struct containing the gradients of the weights and biases of the network based on the input, expected output, and actual output
-        GradientStruct back_propagation(const Matrix& input, const Matrix& expected_output);
+        // Back propagation function that will return the gradients of the weights and biases of the network based on the input, expected output, and actual output
+        // The gradients come in the flat layout of the parameters, get_layers().weights(gradients.data(), layer) picks out one layer's
+        // For a batch the gradients are averaged over its rows, so a batch of one is plain per-sample gradient descent
+        // The gradients are written into a buffer owned by the network, which is reused by the next call
+        const Matrix& back_propagation(const Matrix& input, const Matrix& expected_output);
 
         // Train the neural network on a given dataset for a specified number of epochs and learning rate
-        void train(const std::vector<std::vector<Record>>& training_data, int epochs, double learning_rate);
+        // Weights are updated once per mini-batch of batch_size samples, the default of 1 updates after every sample
+        // Every update goes through the optimizer set with set_optimizer, plain SGD unless another one was chosen
+        // Epochs are counted on from get_epochs_completed(), so training a loaded checkpoint picks up where it stopped
+        // Always runs all epochs, a TrainingController (trainer.hpp) can stop early, follow a schedule or keep to a time budget
+        // A learning rate of 0 runs the epochs without changing the weights, throws std::invalid_argument for a negative
+        // learning rate or a batch_size of 0
+        void train(const DatasetView& training_data, int epochs, double learning_rate, unsigned int batch_size = 1);
+
+        // Run one pass over the samples in mini-batches and return the summed cost of all samples
+        // Each batch is a slice of the dataset fed to the network in place, nothing is copied
+        // A checkpoint is saved whenever the epoch count reaches a multiple of the checkpoint interval
+        double train_epoch(const DatasetView& samples, double learning_rate, unsigned int batch_size = 1);
+
+        // Number of threads each mini-batch is sharded across during training, 1 (the default) trains on the calling thread
+        // Shard boundaries and the gradient reduction order only depend on this count, so for a fixed count results are bitwise reproducible
+        void set_num_threads(unsigned int threads);
+        unsigned int get_num_threads() const { return num_threads; }
+
+        // Asynchronous lock-free SGD (Hogwild): threads workers each run per-sample forward and back propagation on their own
+        // share of the samples and apply their updates to the shared weights without any locking
+        // Much higher throughput on large datasets, but results vary from run to run, returns the average cost of the last epoch
+        // Workers always apply plain SGD, a stateful optimizer cannot be shared without locks, so any other one throws std::logic_error
+        // Throws std::invalid_argument for empty samples, a negative learning rate or 0 threads
+        double train_async(const DatasetView& samples, int epochs, double learning_rate, unsigned int threads);
 
         // Test the neural network on a given dataset and print the accuracy of the network
-        void test(const std::vector<std::vector<Record>>& testing_data);
+        void test(const DatasetView& testing_data);
+
+        // Percentage of samples whose predicted class matches their label
+        double evaluate(const DatasetView& samples) const;
+
+        // Thread-safe inference on a batch of inputs (one sample per row), the activations of every layer are left in ws
+        // and the returned output is ws.output(). The network itself is not modified
+        MatrixView predict_batch(const MatrixView& input, InferenceWorkspace& ws) const;
+
+        // Thread-safe inference that returns its own copy of the output, convenient but allocates on every call
+        Matrix predict(const MatrixView& input) const;
+
+        // Write the weights, biases, normalizer and epoch count to a model file, see modelFile.hpp
+        void save(const std::string& path) const;
+
+        // Network with the parameters stored in a model file, throws std::runtime_error if the file cannot be loaded
+        // Training is deterministic for a given starting point, so resuming from a checkpoint and training the remaining
+        // epochs gives the same weights as one uninterrupted run
+        static NeuralNetwork load(const std::string& path);
+
+        // Save a checkpoint to path every interval epochs, and once more when train() or a TrainingController finishes
+        // An interval of 0 (the default) turns checkpointing off
+        void set_checkpointing(const std::string& path, unsigned int interval);
+
+        // Save a checkpoint right away, does nothing while checkpointing is off
+        void save_checkpoint() const;
+
+        // Epochs trained so far, including the ones before the network was saved
+        std::uint64_t get_epochs_completed() const { return epochs_completed; }
 
         // Update the weights and biases of the network based on the calculated gradients and the learning rate
-        void update_weights(const GradientStruct& gradients, double learning_rate);
+        // gradients is a flat buffer in the parameter layout, as returned by back_propagation, and goes through the optimizer
+        void update_weights(const Matrix& gradients, double learning_rate);
+
+        // Choose the update rule used from the next update on, its state starts from zero
+        // Throws std::invalid_argument for hyperparameters the optimizer rejects
+        void set_optimizer(const OptimizerSpec& spec) { optimizer = Optimizer(spec); }
+        const Optimizer& get_optimizer() const { return optimizer; }
 
-        Matrix getW1() const { return W1; }
-        Matrix getW2() const { return W2; }
-        Matrix getA1() const { return a1_cache; }
+        // Normalization of raw inputs the network was trained with, kept with the model so new measurements can be
+        // scaled exactly like the training data before they are passed to predict. Empty unless set
+        void set_normalizer(const Normalizer& fitted) { normalizer = fitted; }
+        const Normalizer& get_normalizer() const { return normalizer; }
+
+        const LayerStack& get_layers() const { return layers; }
+        unsigned int num_layers() const { return layers.num_layers(); }
+
+        // Weights (inputs x units) and bias (1 x units) of one layer, views into the parameter buffer that follow every update
+        MatrixView weights(unsigned int layer) const { return layers.weights(parameters.data(), layer); }
+        MatrixView bias(unsigned int layer) const { return layers.bias(parameters.data(), layer); }
+
+        // Every weight and bias of the network in one flat buffer, laid out as described by get_layers()
+        const Matrix& get_parameters() const { return parameters; }
+
+        // Overwrite every weight and bias, e.g. to go back to an earlier snapshot of get_parameters()
+        // Throws std::invalid_argument if values does not have the size of the parameter buffer
+        void set_parameters(const Matrix& values);
+
+        // Go back to an earlier point of training, the parameters, the optimizer state (see Optimizer::get_state) and
+        // the epoch count together, so a checkpoint saved afterwards resumes from that point
+        // Throws std::invalid_argument if values or optimizer_state do not fit the network and its optimizer
+        void rewind(const Matrix& values, const Matrix& optimizer_state, std::uint64_t optimizer_steps, std::uint64_t epochs);
 
     private:
 
-        // The number of input, output, and hidden layer nodes
-        unsigned int inputNum;
-        unsigned int outputNum;
-        unsigned int hiddenLayerNum;
-        
-        // The weights of the network, initialized in the constructor
-        Matrix W1;
-        Matrix W2;
-
-        // The biases of the network, initialized in the constructor
-        Matrix b1;
-        Matrix b2;
-
-        // Caches for the forward pass values, these are used in the back propagation step to calculate the gradients
-        Matrix z1_cache;
-        Matrix a1_cache;
-        Matrix z2_cache;
-        Matrix input_cache;
+        // Shape of the network and the layout of its parameters
+        LayerStack layers;
+
+        // The weights and biases of every layer, initialized in the constructor
+        Matrix parameters;
+
+        Normalizer normalizer;
+
+        // Update rule and its per-parameter state, saved with checkpoints so a resumed run continues exactly
+        Optimizer optimizer;
+
+        std::uint64_t epochs_completed;
+        std::string checkpoint_path;
+        unsigned int checkpoint_interval;
+
+        // Caches and scratch used by forward_propagation, back_propagation and single threaded training
+        TrainingWorkspace workspace;
+
+        // Data-parallel training state, one workspace per shard and the reduced gradients of the whole batch
+        unsigned int num_threads;
+        std::shared_ptr<ThreadPool> pool;
+        std::vector<TrainingWorkspace> shard_workspaces;
+        std::vector<double> shard_costs;
+        Matrix reduced_gradients;
+
+        // Train on one batch with its samples sharded across the pool, returns the summed cost
+        double train_batch_parallel(const DatasetView& batch, double learning_rate);
 
 };
 
-inline double sigmoid(double x);
-double mean_squared_error(const Matrix& prediction, const Matrix& actual);
+// Index of the largest entry of the given row, i.e. the predicted class of that sample
+unsigned int argmax_row(const MatrixView& output, unsigned int row);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,50 @@
+#ifndef NORMALIZER_HPP
+#define NORMALIZER_HPP
+
+// Fitted per-feature normalization
+// The statistics come from the training split only, in a single streaming pass, and the same Normalizer is then applied
+// to the training data, the testing data and anything the trained network is later asked to classify
+
+#include <cstddef>
+#include <vector>
+#include "dataset.hpp"
+
+enum class NormalizationMethod {
+    // (x - min) / (max - min), maps the fitted range onto [0, 1]
+    MinMax,
+
+    // (x - mean) / standard deviation
+    ZScore
+};
+
+class Normalizer {
+public:
+    // A normalizer without features, applying it leaves the data unchanged
+    Normalizer();
+
+    // Use known scaling, e.g. read back from a saved model
+    explicit Normalizer(std::vector<FeatureScaling> scaling);
+
+    // Compute the statistics of every feature of samples in one pass over the rows
+    // A feature that is constant in samples keeps a scale of 1 so it is only shifted
+    static Normalizer fit(const DatasetView& samples, NormalizationMethod method);
+
+    unsigned int num_features() const { return static_cast<unsigned int>(scaling.size()); }
+    bool empty() const { return scaling.empty(); }
+    const std::vector<FeatureScaling>& get_scaling() const { return scaling; }
+
+    // Normalize rows samples of num_features() values each, stored row-major, in place
+    void apply(double* values, std::size_t rows) const;
+
+    // Normalize every sample of data in place, throws if the feature counts differ
+    void apply(Dataset& data) const;
+
+private:
+    std::vector<FeatureScaling> scaling;
+
+    // The parameters repeated for four consecutive rows, the period of the vector kernel
+    std::vector<double> lane_offsets;
+    std::vector<double> lane_scales;
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef OPTIMIZER_HPP
+#define OPTIMIZER_HPP
+
+// Update rules that turn gradients into parameter changes
+// An optimizer works on the network's flat parameter buffer, so every weight and bias of every layer is updated in one
+// fused pass, and whatever state the rule keeps per parameter lives in one contiguous buffer in that same layout.
+
+#include <cstddef>
+#include <cstdint>
+#include "matrix.hpp"
+
+enum class OptimizerKind {
+    // p -= lr * g
+    SGD,
+    // v = beta1 * v + g, p -= lr * v
+    Momentum,
+    // s = beta2 * s + (1 - beta2) * g^2, p -= lr * g / (sqrt(s) + epsilon)
+    RMSProp,
+    // Running means of g and g^2 with bias correction, see Kingma and Ba, "Adam: A Method for Stochastic Optimization"
+    Adam
+};
+
+// Hyperparameters of an update rule, the learning rate is not part of it and is passed to every step instead,
+// so it can follow a schedule without touching the optimizer
+struct OptimizerSpec {
+    OptimizerKind kind;
+
+    // Decay of the first moment, the velocity of Momentum and the mean gradient of Adam
+    double beta1;
+
+    // Decay of the second moment, the mean squared gradient of RMSProp and Adam
+    double beta2;
+
+    // Keeps the division of RMSProp and Adam away from zero
+    double epsilon;
+
+    static OptimizerSpec sgd();
+    static OptimizerSpec momentum(double beta = 0.9);
+    static OptimizerSpec rmsprop(double decay = 0.9, double epsilon = 1e-8);
+    static OptimizerSpec adam(double beta1 = 0.9, double beta2 = 0.999, double epsilon = 1e-8);
+};
+
+const char* optimizer_name(OptimizerKind kind);
+
+class Optimizer {
+public:
+    // Throws std::invalid_argument if a decay is outside [0, 1) or epsilon is not positive
+    explicit Optimizer(const OptimizerSpec& spec = OptimizerSpec::sgd());
+
+    const OptimizerSpec& get_spec() const { return spec; }
+
+    // Values of state kept per parameter, 0 for SGD, 1 for Momentum and RMSProp, 2 for Adam
+    unsigned int state_slots() const;
+
+    // Apply one update to count parameters, allocating zeroed state on the first step
+    // Padding between tensors has zero gradients and zero state, so it stays untouched by every rule
+    void step(double* parameters, const double* gradients, std::size_t count, double learning_rate);
+
+    // Number of steps taken so far, Adam's bias correction depends on it
+    std::uint64_t get_steps() const { return steps; }
+
+    // state_slots() blocks of the parameter count, one after the other, empty before the first step
+    const Matrix& get_state() const { return state; }
+
+    // Continue from saved state, count being either 0 or state_slots() times the parameter count
+    void restore(const double* values, std::size_t count, std::uint64_t steps_taken);
+
+    // Forget all state, the next step starts from scratch
+    void reset();
+
+private:
+    OptimizerSpec spec;
+    Matrix state;
+    std::uint64_t steps;
+};
+
+#endif
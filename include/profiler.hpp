@@ -0,0 +1,128 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+// Built-in scoped timers and counters for the training and inference hot paths
+// Every thread accumulates into its own buffer, so recording never takes a lock or shares a cache line with another
+// thread, and a snapshot sums the buffers of all threads, including the ones that have already exited.
+// The IRIS_PROFILE_* macros only record anything when the build defines IRIS_PROFILING (the IRIS_PROFILING CMake
+// option), otherwise they compile to nothing and the functions below report zeros.
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+#if defined(IRIS_PROFILING) && (defined(__x86_64__) || defined(_M_X64))
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #else
+        #include <x86intrin.h>
+    #endif
+#endif
+
+// Timed sections, a phase may run inside another one (e.g. Inference during Validation), times are inclusive
+enum class ProfilePhase {
+    Epoch,
+    // Slicing batches and shards out of the dataset
+    DataAssembly,
+    Forward,
+    Loss,
+    Backward,
+    // Summing the gradients of the shards of a data-parallel batch
+    GradientReduction,
+    WeightUpdate,
+    // Copying the shared weights into a Hogwild worker's replica
+    ParameterSync,
+    Validation,
+    Inference,
+    Checkpoint,
+    DataLoad,
+    Count
+};
+
+enum class ProfileCounter {
+    // Samples that went through a training step
+    Samples,
+    // Every Matrix constructed, and the ones of those and of resize calls that had to allocate a buffer
+    MatrixConstructions,
+    MatrixAllocations,
+    BytesAllocated,
+    Count
+};
+
+constexpr unsigned int PROFILE_PHASES = static_cast<unsigned int>(ProfilePhase::Count);
+constexpr unsigned int PROFILE_COUNTERS = static_cast<unsigned int>(ProfileCounter::Count);
+
+const char* profile_phase_name(ProfilePhase phase);
+const char* profile_counter_name(ProfileCounter counter);
+
+// True when the library was built with IRIS_PROFILING
+bool profiling_compiled_in();
+
+// Totals of every thread since the last profile_reset
+struct ProfileReport {
+    std::uint64_t phase_ns[PROFILE_PHASES];
+    std::uint64_t phase_calls[PROFILE_PHASES];
+    std::uint64_t counters[PROFILE_COUNTERS];
+    std::uint64_t wall_ns;
+};
+
+ProfileReport profile_snapshot();
+
+// Zero every total and drop recorded trace events, best called while nothing is being profiled
+void profile_reset();
+
+// Also keep one event per timed section for write_chrome_trace, off by default since it grows with every section
+// At most max_events are kept per thread, later sections are still timed but not traced
+void profile_set_tracing(bool enabled, std::size_t max_events = 1 << 20);
+
+// Totals, calls and per-call averages of every phase, the counters with their values per weight update and per epoch,
+// and training samples per second of epoch time
+void write_profile_json(std::ostream& out, const ProfileReport& report);
+
+// The traced sections in the Chrome trace event format, for chrome://tracing or Perfetto
+void write_chrome_trace(std::ostream& out);
+
+// Recording side, used through the macros below
+std::uint64_t profile_ticks_now();
+void profile_record_phase(ProfilePhase phase, std::uint64_t start_ticks, std::uint64_t end_ticks);
+void profile_add(ProfileCounter counter, std::uint64_t amount);
+
+#if defined(IRIS_PROFILING)
+
+// Raw timestamps, the time stamp counter on x86-64 and steady_clock nanoseconds elsewhere
+// Ticks are converted to nanoseconds only when a report is made, from the ticks and clock time elapsed since the reset
+inline std::uint64_t profile_ticks(){
+#if defined(__x86_64__) || defined(_M_X64)
+    return __rdtsc();
+#else
+    return profile_ticks_now();
+#endif
+}
+
+// Times the enclosing scope as one call of phase
+class ProfileScope {
+public:
+    explicit ProfileScope(ProfilePhase phase) : phase(phase), start(profile_ticks()) {}
+    ~ProfileScope() { profile_record_phase(phase, start, profile_ticks()); }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    ProfilePhase phase;
+    std::uint64_t start;
+};
+
+#define IRIS_PROFILE_CONCAT_INNER(a, b) a##b
+#define IRIS_PROFILE_CONCAT(a, b) IRIS_PROFILE_CONCAT_INNER(a, b)
+#define IRIS_PROFILE_SCOPE(phase) ProfileScope IRIS_PROFILE_CONCAT(iris_profile_scope_, __LINE__)(phase)
+#define IRIS_PROFILE_COUNT(counter, amount) profile_add(counter, static_cast<std::uint64_t>(amount))
+
+#else
+
+#define IRIS_PROFILE_SCOPE(phase) ((void)0)
+#define IRIS_PROFILE_COUNT(counter, amount) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef SIMD_HPP
+#define SIMD_HPP
+
+// Shared setup of the x86 vector kernels
+// IRIS_SIMD_X86 is 1 where the AVX intrinsics can be compiled. IRIS_TARGET(features) then builds a single function for
+// the given instruction sets without raising the target of the whole build, so every kernel is compiled in and the
+// right one is picked at run time. MSVC compiles intrinsics without it.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define IRIS_SIMD_X86 1
+    #define IRIS_TARGET(features) __attribute__((target(features)))
+    #include <immintrin.h>
+#elif defined(_MSC_VER) && defined(_M_X64)
+    #define IRIS_SIMD_X86 1
+    #define IRIS_TARGET(features)
+    #include <immintrin.h>
+#else
+    #define IRIS_SIMD_X86 0
+#endif
+
+// True if the AVX2 kernels outside the GEMM may run. They follow the GEMM kernel choice (gemm.hpp), so the CPU check is
+// done once and IRIS_GEMM_KERNEL=scalar turns off every vector kernel at once
+bool vector_kernels_enabled();
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef SNAPSHOT_BUFFER_HPP
+#define SNAPSHOT_BUFFER_HPP
+
+// Lock-free hand-off of the latest value from one writer thread to one reader thread
+// Three slots rotate between the writer's back slot, a shared middle slot and the reader's front slot. Publishing swaps
+// the back slot into the middle and refreshing swaps the middle into the front, each a single atomic exchange, so
+// neither side ever waits for the other and the reader never sees a half-written value. Slots are reused, values with
+// buffers of their own (Matrix, std::vector) stop allocating once every slot has been filled once.
+
+#include <atomic>
+
+template <typename T>
+class SnapshotBuffer {
+public:
+    SnapshotBuffer() : back_slot(0), front_slot(1), middle(2) {}
+
+    SnapshotBuffer(const SnapshotBuffer&) = delete;
+    SnapshotBuffer& operator=(const SnapshotBuffer&) = delete;
+
+    // Writer side: fill back() and publish it, afterwards back() is another slot holding an older value
+    T& back() { return slots[back_slot]; }
+    void publish(){
+        back_slot = middle.exchange(back_slot | FRESH, std::memory_order_acq_rel) & SLOT_MASK;
+    }
+
+    // Reader side: pick up the last published value if there is one the reader has not seen, returns whether it did
+    bool refresh(){
+        if((middle.load(std::memory_order_relaxed) & FRESH) == 0){
+            return false;
+        }
+        front_slot = middle.exchange(front_slot, std::memory_order_acq_rel) & SLOT_MASK;
+        return true;
+    }
+    const T& front() const { return slots[front_slot]; }
+
+private:
+    static constexpr unsigned int SLOT_MASK = 3;
+    static constexpr unsigned int FRESH = 4;
+
+    T slots[3];
+    unsigned int back_slot;
+    unsigned int front_slot;
+
+    // Index of the middle slot, with FRESH set while it holds a value the reader has not picked up yet
+    std::atomic<unsigned int> middle;
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size fork/join pool: parallel_for hands out task indices to the workers and the calling thread,
+// then blocks until every task has finished
+class ThreadPool {
+public:
+    // num_threads counts the calling thread, so a pool of 1 runs everything inline
+    explicit ThreadPool(unsigned int num_threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned int size() const { return static_cast<unsigned int>(workers.size()) + 1; }
+
+    // Run task(i) for every i in [0, count) and wait for all of them
+    // Calls from different threads are serialized, the first exception thrown by a task is rethrown here
+    void parallel_for(unsigned int count, const std::function<void(unsigned int)>& task);
+
+private:
+    void worker_loop();
+    void run_tasks();
+
+    std::vector<std::thread> workers;
+
+    // Serializes whole parallel_for calls
+    std::mutex job_mutex;
+
+    // Guards the state of the job currently being run
+    std::mutex state_mutex;
+    std::condition_variable work_ready;
+    std::condition_variable work_done;
+
+    const std::function<void(unsigned int)>* current_task;
+    unsigned int task_count;
+    unsigned int next_task;
+    unsigned int completed_tasks;
+    std::uint64_t generation;
+    bool stopping;
+    std::exception_ptr first_error;
+};
+
+#endif
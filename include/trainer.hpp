@@ -0,0 +1,161 @@
+#ifndef TRAINER_HPP
+#define TRAINER_HPP
+
+// Training driven by convergence instead of a fixed epoch count
+// A TrainingController runs epochs on a network until the monitored loss stops improving, a time budget runs out, an
+// epoch callback asks it to stop or the epoch limit is reached, adjusting the learning rate by a schedule on the way.
+// It can run to completion in one call or one epoch at a time, which lets the visualizer draw between epochs.
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include "matrix.hpp"
+#include "dataset.hpp"
+#include "layers.hpp"
+
+class NeuralNetwork;
+
+enum class LearningRateSchedule {
+    // learning_rate on every epoch
+    Constant,
+    // Multiplied by decay every decay_epochs epochs
+    Step,
+    // Multiplied by decay per decay_epochs epochs, smoothly in between
+    Exponential,
+    // Follows half a cosine from learning_rate down to min_learning_rate over max_epochs
+    Cosine,
+    // Multiplied by decay whenever the monitored loss has not improved for decay_epochs epochs
+    ReduceOnPlateau
+};
+
+struct TrainingOptions {
+    // Upper bound on the epochs of one run
+    unsigned int max_epochs = 1000;
+    double learning_rate = 0.1;
+    unsigned int batch_size = 1;
+
+    LearningRateSchedule schedule = LearningRateSchedule::Constant;
+    double decay = 0.5;
+    unsigned int decay_epochs = 100;
+    double min_learning_rate = 0.0;
+
+    // Stop once the monitored loss has not improved by more than min_delta for patience epochs, 0 turns it off
+    // The monitored loss is the average validation loss when a validation set is given, the training cost otherwise
+    unsigned int patience = 0;
+    double min_delta = 0.0;
+
+    // When patience stops training, go back to the epoch with the best monitored loss: its parameters, optimizer state
+    // and epoch count are restored together, so the final checkpoint resumes from that epoch
+    bool restore_best = true;
+
+    // Stop after the first epoch that ends past this many seconds of training, 0 means no limit
+    double time_budget_seconds = 0.0;
+};
+
+enum class StopReason {
+    MaxEpochs,
+    EarlyStopping,
+    TimeBudget,
+    Callback
+};
+
+const char* stop_reason_name(StopReason reason);
+
+// Passed to the epoch callback after every epoch
+struct EpochReport {
+    // Index of the epoch just trained, counted over the network's whole life like NeuralNetwork::get_epochs_completed
+    std::uint64_t epoch;
+
+    // Epochs trained by this controller so far, including this one
+    unsigned int epochs_run;
+
+    // Average cost per training sample of this epoch
+    double training_cost;
+
+    // Average loss per validation sample after this epoch, equal to training_cost without a validation set
+    double monitored_loss;
+
+    // Rate this epoch was trained with
+    double learning_rate;
+
+    // This epoch has the best monitored loss so far
+    bool improved;
+
+    double elapsed_seconds;
+};
+
+struct TrainingResult {
+    StopReason reason = StopReason::MaxEpochs;
+    unsigned int epochs_run = 0;
+
+    // Index of the epoch with the lowest monitored loss, and that loss
+    std::uint64_t best_epoch = 0;
+    double best_loss = 0.0;
+
+    double elapsed_seconds = 0.0;
+};
+
+// Return false to stop training after this epoch
+using EpochCallback = std::function<bool(const EpochReport&)>;
+
+// The first samples of a shuffled set for training and the last fraction of it held out for validation
+struct ValidationSplit {
+    DatasetView training;
+    DatasetView validation;
+};
+
+// Throws std::invalid_argument unless 0 < fraction < 1 leaves samples on both sides
+ValidationSplit hold_out(const DatasetView& samples, double fraction);
+
+class TrainingController {
+public:
+    // The network and both views have to outlive the controller, validation may be empty
+    // Throws std::invalid_argument for an empty training set or options out of range
+    TrainingController(NeuralNetwork& network, const DatasetView& training, const DatasetView& validation, const TrainingOptions& options);
+
+    // Called after every epoch, including the last
+    void on_epoch(EpochCallback callback) { epoch_callback = std::move(callback); }
+
+    // Train one epoch, returns false once training has stopped and nothing was trained
+    bool step();
+
+    // Train until a stopping condition is met
+    const TrainingResult& run();
+
+    bool finished() const { return done; }
+    const EpochReport& last_report() const { return report; }
+    const TrainingResult& get_result() const { return result; }
+
+    // Learning rate the next epoch will use
+    double current_learning_rate() const { return learning_rate; }
+
+private:
+    NeuralNetwork& network;
+    DatasetView training;
+    DatasetView validation;
+    TrainingOptions options;
+    EpochCallback epoch_callback;
+
+    std::chrono::steady_clock::time_point start;
+    bool started;
+    bool done;
+
+    double learning_rate;
+    unsigned int epochs_since_best;
+
+    // State of the network after the best epoch, only kept when patience and restore_best are both set
+    bool keep_best;
+    Matrix best_parameters;
+    Matrix best_optimizer_state;
+    std::uint64_t best_optimizer_steps;
+    std::uint64_t best_epochs_completed;
+    InferenceWorkspace validation_ws;
+
+    EpochReport report;
+    TrainingResult result;
+
+    double scheduled_rate(unsigned int epoch) const;
+    void finish(StopReason reason);
+};
+
+#endif
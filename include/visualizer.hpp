@@ -3,4 +3,4 @@
 #include "neuralNetwork.hpp"
 #include "dataExtract.hpp"
 
-void run_visualization(NeuralNetwork& nn, const std::vector<std::vector<Record>>& data);
\ No newline at end of file
+void run_visualization(NeuralNetwork& nn, const DataSplit& data);
\ No newline at end of file
@@ -7,6 +7,7 @@
 int main() {
     auto data = getCsvData();
     NeuralNetwork nn(4, 5, 3);
+    nn.set_normalizer(data.normalizer);
     run_visualization(nn, data);
     return 0;
 }
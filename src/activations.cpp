@@ -0,0 +1,285 @@
+// Activation kernels: exact scalar loops and the polynomial exp the fast ones are built on
+
+#include "activations.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+// exp(x) = 2^k * exp(r) with k = round(x / ln 2) and |r| <= ln 2 / 2, exp(r) from its Taylor series up to r^11
+// ln 2 is split into a short high part and a correction, so k * ln 2 is subtracted without rounding error
+const double LOG2E = 1.4426950408889634;
+const double LN2_HI = 6.93145751953125e-1;
+const double LN2_LO = 1.42860682030941723212e-6;
+
+// Inputs are clamped so 2^k stays a normal double, exp(-708) is already below 1e-307
+const double EXP_MIN = -708.0;
+const double EXP_MAX = 709.0;
+
+// 1/11!, 1/10!, ..., 1/2!, 1, 1 for Horner's scheme
+const double EXP_COEFFS[12] = {
+    2.505210838544172e-08, 2.755731922398589e-07, 2.7557319223985893e-06, 2.48015873015873e-05,
+    1.984126984126984e-04, 1.3888888888888889e-03, 8.333333333333333e-03, 4.1666666666666664e-02,
+    1.6666666666666666e-01, 0.5, 1.0, 1.0
+};
+
+// Adding and subtracting 1.5 * 2^52 rounds a double of magnitude below 2^51 to the nearest integer without a libm call
+const double ROUNDING_SHIFT = 6755399441055744.0;
+
+// Values processed per step by the vector kernels, one ymm register of doubles
+const unsigned int LANES = 4;
+
+double exp_fast(double x){
+    if(std::isnan(x)){
+        return x;
+    }
+    x = std::min(std::max(x, EXP_MIN), EXP_MAX);
+
+    double k = (x * LOG2E + ROUNDING_SHIFT) - ROUNDING_SHIFT;
+    double r = x - k * LN2_HI;
+    r = r - k * LN2_LO;
+
+    double p = EXP_COEFFS[0];
+    for(unsigned int i = 1; i < 12; i++){
+        p = p * r + EXP_COEFFS[i];
+    }
+
+    // 2^k built straight from its exponent bits
+    std::int64_t bits = (static_cast<std::int64_t>(k) + 1023) << 52;
+    double scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return p * scale;
+}
+
+#if IRIS_SIMD_X86
+
+IRIS_TARGET("avx2,fma")
+inline __m256d exp_avx2(__m256d x){
+    // max / min return their second operand when either is NaN, so NaN inputs come out as NaN
+    x = _mm256_max_pd(_mm256_set1_pd(EXP_MIN), x);
+    x = _mm256_min_pd(_mm256_set1_pd(EXP_MAX), x);
+
+    __m256d k = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(LOG2E)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d r = _mm256_fnmadd_pd(k, _mm256_set1_pd(LN2_HI), x);
+    r = _mm256_fnmadd_pd(k, _mm256_set1_pd(LN2_LO), r);
+
+    __m256d p = _mm256_set1_pd(EXP_COEFFS[0]);
+    for(unsigned int i = 1; i < 12; i++){
+        p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(EXP_COEFFS[i]));
+    }
+
+    __m256i exponent = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(k));
+    exponent = _mm256_slli_epi64(_mm256_add_epi64(exponent, _mm256_set1_epi64x(1023)), 52);
+    return _mm256_mul_pd(p, _mm256_castsi256_pd(exponent));
+}
+
+// Lanes of a final partial register that still hold values, the rest are neither loaded nor stored
+IRIS_TARGET("avx2,fma")
+inline __m256i tail_mask(std::size_t remaining){
+    return _mm256_cmpgt_epi64(_mm256_set1_epi64x(static_cast<long long>(remaining)), _mm256_setr_epi64x(0, 1, 2, 3));
+}
+
+// Applies op to count values four at a time, a short tail goes through one masked step instead of a scalar loop,
+// which matters because the rows of small layers are only a handful of values wide
+template <typename Op>
+IRIS_TARGET("avx2,fma")
+inline void map_avx2(const double* in, double* out, std::size_t count, Op op){
+    std::size_t i = 0;
+    for(; i + LANES <= count; i += LANES){
+        _mm256_storeu_pd(out + i, op(_mm256_loadu_pd(in + i)));
+    }
+    if(i < count){
+        __m256i mask = tail_mask(count - i);
+        _mm256_maskstore_pd(out + i, mask, op(_mm256_maskload_pd(in + i, mask)));
+    }
+}
+
+struct SigmoidOp {
+    IRIS_TARGET("avx2,fma")
+    __m256d operator()(__m256d x) const {
+        const __m256d one = _mm256_set1_pd(1.0);
+        return _mm256_div_pd(one, _mm256_add_pd(one, exp_avx2(_mm256_sub_pd(_mm256_setzero_pd(), x))));
+    }
+};
+
+// tanh(x) = 2 * sigmoid(2x) - 1
+struct TanhOp {
+    IRIS_TARGET("avx2,fma")
+    __m256d operator()(__m256d x) const {
+        const __m256d one = _mm256_set1_pd(1.0);
+        __m256d e = exp_avx2(_mm256_mul_pd(_mm256_set1_pd(-2.0), x));
+        return _mm256_sub_pd(_mm256_div_pd(_mm256_set1_pd(2.0), _mm256_add_pd(one, e)), one);
+    }
+};
+
+struct ExpOp {
+    IRIS_TARGET("avx2,fma")
+    __m256d operator()(__m256d x) const { return exp_avx2(x); }
+};
+
+#endif
+
+void sigmoid_block(const double* z, double* a, std::size_t count){
+    if(active_activation_precision() == ActivationPrecision::Exact){
+        for(std::size_t i = 0; i < count; i++){
+            a[i] = 1.0 / (1.0 + std::exp(-z[i]));
+        }
+        return;
+    }
+
+#if IRIS_SIMD_X86
+    if(vector_kernels_enabled()){
+        map_avx2(z, a, count, SigmoidOp());
+        return;
+    }
+#endif
+    for(std::size_t i = 0; i < count; i++){
+        a[i] = 1.0 / (1.0 + exp_fast(-z[i]));
+    }
+}
+
+void tanh_block(const double* z, double* a, std::size_t count){
+    if(active_activation_precision() == ActivationPrecision::Exact){
+        for(std::size_t i = 0; i < count; i++){
+            a[i] = std::tanh(z[i]);
+        }
+        return;
+    }
+
+#if IRIS_SIMD_X86
+    if(vector_kernels_enabled()){
+        map_avx2(z, a, count, TanhOp());
+        return;
+    }
+#endif
+    for(std::size_t i = 0; i < count; i++){
+        a[i] = 2.0 / (1.0 + exp_fast(-2.0 * z[i])) - 1.0;
+    }
+}
+
+void exp_block(const double* x, double* out, std::size_t count){
+    if(active_activation_precision() == ActivationPrecision::Exact){
+        for(std::size_t i = 0; i < count; i++){
+            out[i] = std::exp(x[i]);
+        }
+        return;
+    }
+
+#if IRIS_SIMD_X86
+    if(vector_kernels_enabled()){
+        map_avx2(x, out, count, ExpOp());
+        return;
+    }
+#endif
+    for(std::size_t i = 0; i < count; i++){
+        out[i] = exp_fast(x[i]);
+    }
+}
+
+// Each row is shifted by its maximum so exp never overflows, then all rows go through one exp pass and are normalized
+void softmax_block(const double* z, double* a, std::size_t count, unsigned int cols){
+    if(cols == 0 || count % cols != 0){
+        throw std::invalid_argument("Softmax needs whole rows");
+    }
+
+    for(std::size_t row = 0; row < count; row += cols){
+        double largest = *std::max_element(z + row, z + row + cols);
+        for(unsigned int j = 0; j < cols; j++){
+            a[row + j] = z[row + j] - largest;
+        }
+    }
+
+    exp_block(a, a, count);
+
+    for(std::size_t row = 0; row < count; row += cols){
+        double sum = 0.0;
+        for(unsigned int j = 0; j < cols; j++){
+            sum += a[row + j];
+        }
+        double inverse = 1.0 / sum;
+        for(unsigned int j = 0; j < cols; j++){
+            a[row + j] *= inverse;
+        }
+    }
+}
+
+ActivationPrecision detect_precision(){
+    const char* forced = std::getenv("IRIS_ACTIVATION_PRECISION");
+    if(forced && std::strcmp(forced, "fast") == 0){
+        return ActivationPrecision::Fast;
+    }
+    return ActivationPrecision::Exact;
+}
+
+std::atomic<int>& precision_choice(){
+    static std::atomic<int> choice(static_cast<int>(detect_precision()));
+    return choice;
+}
+
+}
+
+ActivationPrecision active_activation_precision(){
+    return static_cast<ActivationPrecision>(precision_choice().load(std::memory_order_relaxed));
+}
+
+void set_activation_precision(ActivationPrecision precision){
+    precision_choice().store(static_cast<int>(precision), std::memory_order_relaxed);
+}
+
+const char* activation_precision_name(ActivationPrecision precision){
+    return precision == ActivationPrecision::Fast ? "fast" : "exact";
+}
+
+void apply_activation(Activation activation, const double* z, double* a, std::size_t count, unsigned int cols){
+    switch(activation){
+        case Activation::Sigmoid:
+            sigmoid_block(z, a, count);
+            break;
+        case Activation::Tanh:
+            tanh_block(z, a, count);
+            break;
+        case Activation::ReLU:
+            for(std::size_t i = 0; i < count; i++){
+                a[i] = z[i] > 0.0 ? z[i] : 0.0;
+            }
+            break;
+        case Activation::Softmax:
+            softmax_block(z, a, count, cols);
+            break;
+        case Activation::Identity:
+            if(a != z){
+                std::copy(z, z + count, a);
+            }
+            break;
+    }
+}
+
+void multiply_activation_slope(Activation activation, const double* a, const double* z, double* error, std::size_t count){
+    switch(activation){
+        case Activation::Sigmoid:
+            for(std::size_t i = 0; i < count; i++){
+                error[i] = error[i] * (a[i] * (1.0 - a[i]));
+            }
+            break;
+        case Activation::Tanh:
+            for(std::size_t i = 0; i < count; i++){
+                error[i] = error[i] * (1.0 - a[i] * a[i]);
+            }
+            break;
+        case Activation::ReLU:
+            for(std::size_t i = 0; i < count; i++){
+                error[i] = z[i] > 0.0 ? error[i] : 0.0;
+            }
+            break;
+        case Activation::Softmax:
+            throw std::logic_error("Softmax is only back propagated through the cross-entropy loss");
+        case Activation::Identity:
+            break;
+    }
+}
@@ -0,0 +1,86 @@
+#include <cstring>
+#include "backgroundTrainer.hpp"
+#include "neuralNetwork.hpp"
+
+BackgroundTrainer::BackgroundTrainer(NeuralNetwork& network, const DatasetView& training, const DatasetView& validation,
+                                     const TrainingOptions& options, const DatasetView& display_samples,
+                                     std::chrono::milliseconds publish_interval)
+    : network(network), controller(network, training, validation, options), display_samples(display_samples),
+      publish_interval(publish_interval), last_published_epochs(0), stop_requested(false), done(false) {
+    controller.on_epoch([this](const EpochReport& report){
+        if(std::chrono::steady_clock::now() - last_publish >= this->publish_interval){
+            publish(report, false);
+        }
+        return !stop_requested.load(std::memory_order_relaxed);
+    });
+
+    last_publish = std::chrono::steady_clock::now();
+    worker = std::thread([this](){ run(); });
+}
+
+BackgroundTrainer::~BackgroundTrainer(){
+    stop();
+    if(worker.joinable()){
+        worker.join();
+    }
+}
+
+void BackgroundTrainer::stop(){
+    stop_requested.store(true, std::memory_order_relaxed);
+}
+
+void BackgroundTrainer::wait(){
+    if(worker.joinable()){
+        worker.join();
+    }
+    if(error){
+        std::exception_ptr thrown = error;
+        error = nullptr;
+        std::rethrow_exception(thrown);
+    }
+}
+
+void BackgroundTrainer::run(){
+    try {
+        controller.run();
+    } catch(...){
+        error = std::current_exception();
+    }
+
+    // The final snapshot holds the parameters training ended with, the best ones when early stopping restored them
+    publish(controller.last_report(), true);
+    done.store(true, std::memory_order_release);
+}
+
+void BackgroundTrainer::publish(const EpochReport& report, bool last){
+    TrainingSnapshot& snapshot = snapshots.back();
+
+    const Matrix& parameters = network.get_parameters();
+    snapshot.parameters.resize(parameters.get_num_rows(), parameters.get_num_col());
+    std::memcpy(snapshot.parameters.data(), parameters.data(), parameters.size() * sizeof(double));
+
+    // The display sample moves on with the epochs so the activations keep changing while the weights settle
+    const LayerStack& layers = network.get_layers();
+    snapshot.activations.resize(layers.num_layers());
+    if(!display_samples.empty()){
+        DatasetView sample = display_samples.slice(report.epochs_run % display_samples.size(), 1);
+        snapshot.sample.assign(sample.feature_row(0), sample.feature_row(0) + sample.num_features());
+
+        network.predict_batch(sample.features(), display_ws);
+        for(unsigned int layer = 0; layer < layers.num_layers(); layer++){
+            MatrixView values = display_ws.activations(layer);
+            snapshot.activations[layer].assign(values.row(0), values.row(0) + values.get_num_col());
+        }
+    }
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - last_publish).count();
+    snapshot.epochs_per_second = seconds > 0.0 ? (report.epochs_run - last_published_epochs) / seconds : 0.0;
+    last_publish = now;
+    last_published_epochs = report.epochs_run;
+
+    snapshot.report = report;
+    snapshot.finished = last;
+    snapshot.result = controller.get_result();
+    snapshots.publish();
+}
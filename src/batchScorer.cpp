@@ -0,0 +1,294 @@
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include "batchScorer.hpp"
+#include "neuralNetwork.hpp"
+#include "threadPool.hpp"
+
+namespace {
+
+// Work area of one thread, kept from block to block so scoring does not allocate once the buffers have grown
+struct ScoreShard {
+    // Parsed samples waiting to be scored, batch_rows x inputs
+    Matrix batch;
+    unsigned int rows = 0;
+    InferenceWorkspace ws;
+
+    // Formatted predictions of the current piece, output_size bytes of output are in use
+    std::vector<char> output;
+    std::size_t output_size = 0;
+
+    // Counts of the current piece, error lines count from the start of the piece
+    std::size_t lines = 0;
+    std::size_t scored = 0;
+    std::vector<CsvError> errors;
+    std::size_t malformed_lines = 0;
+};
+
+struct ScoreContext {
+    const MappedModel& model;
+    const ScoreOptions& options;
+    unsigned int inputs;
+    unsigned int outputs;
+
+    // Upper bound on the length of one output line
+    std::size_t line_bytes;
+};
+
+bool is_blank(char c){
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+void trim(const char*& begin, const char*& end){
+    while(begin < end && is_blank(*begin)) begin++;
+    while(end > begin && is_blank(end[-1])) end--;
+}
+
+void report_error(std::vector<CsvError>& errors, std::size_t& malformed_lines, std::size_t line, std::string message){
+    if(errors.size() < CsvBlock::MAX_REPORTED_ERRORS){
+        errors.push_back(CsvError{line, std::move(message)});
+    }
+    malformed_lines++;
+}
+
+// Parse the first inputs fields of a non-blank line into row, returns false and fills message if the line is malformed
+bool parse_fields(const char* begin, const char* end, unsigned int inputs, double* row, std::string& message){
+    const char* field = begin;
+    for(unsigned int i = 0; i < inputs; i++){
+        const char* comma = static_cast<const char*>(std::memchr(field, ',', end - field));
+        const char* field_end = comma ? comma : end;
+
+        const char* first = field;
+        const char* last = field_end;
+        trim(first, last);
+        auto parsed = std::from_chars(first, last, row[i]);
+        if(first == last || parsed.ec != std::errc() || parsed.ptr != last){
+            message = "field " + std::to_string(i + 1) + " is not a number: '" + std::string(field, field_end) + "'";
+            return false;
+        }
+        if(comma == nullptr && i + 1 < inputs){
+            message = "expected at least " + std::to_string(inputs) + " fields, found " + std::to_string(i + 1);
+            return false;
+        }
+        field = field_end + 1;
+    }
+    return true;
+}
+
+// Normalize and score the parsed samples of the shard and append their predictions to its output
+void flush_batch(const ScoreContext& ctx, ScoreShard& shard){
+    if(shard.rows == 0){
+        return;
+    }
+
+    double* values = shard.batch.data();
+    ctx.model.get_normalizer().apply(values, shard.rows);
+    MatrixView output = ctx.model.predict_batch(MatrixView(values, shard.rows, ctx.inputs), shard.ws);
+
+    // Room for the whole batch up front, so formatting a line never checks the space left
+    std::size_t needed = shard.output_size + shard.rows * ctx.line_bytes;
+    if(needed > shard.output.size()){
+        shard.output.resize(std::max(needed, shard.output.size() * 2));
+    }
+
+    char* cursor = shard.output.data() + shard.output_size;
+    const std::vector<std::string>& names = ctx.options.class_names;
+    for(unsigned int r = 0; r < shard.rows; r++){
+        unsigned int predicted = argmax_row(output, r);
+        if(names.empty()){
+            cursor = std::to_chars(cursor, cursor + ctx.line_bytes, predicted).ptr;
+        } else {
+            std::memcpy(cursor, names[predicted].data(), names[predicted].size());
+            cursor += names[predicted].size();
+        }
+
+        if(ctx.options.probabilities){
+            const double* activations = output.row(r);
+            for(unsigned int j = 0; j < ctx.outputs; j++){
+                *cursor++ = ',';
+                cursor = std::to_chars(cursor, cursor + ctx.line_bytes, activations[j], std::chars_format::general, ctx.options.precision).ptr;
+            }
+        }
+        *cursor++ = '\n';
+    }
+
+    shard.output_size = cursor - shard.output.data();
+    shard.scored += shard.rows;
+    shard.rows = 0;
+}
+
+// Score every line in [begin, end), which starts at the beginning of a line
+void score_piece(const ScoreContext& ctx, ScoreShard& shard, const char* begin, const char* end){
+    std::string message;
+    while(begin < end){
+        const char* newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+        const char* line_end = newline ? newline : end;
+
+        const char* first = begin;
+        const char* last = line_end;
+        trim(first, last);
+        if(first != last){
+            double* row = shard.batch.data() + static_cast<std::size_t>(shard.rows) * ctx.inputs;
+            if(parse_fields(first, last, ctx.inputs, row, message)){
+                if(++shard.rows == ctx.options.batch_rows){
+                    flush_batch(ctx, shard);
+                }
+            } else {
+                report_error(shard.errors, shard.malformed_lines, shard.lines + 1, message);
+            }
+        }
+
+        shard.lines++;
+        begin = newline ? newline + 1 : end;
+    }
+    flush_batch(ctx, shard);
+}
+
+// Start of the line after the last newline in [begin, end), begin if there is none
+const char* last_line_start(const char* begin, const char* end){
+    for(const char* cursor = end; cursor > begin; cursor--){
+        if(cursor[-1] == '\n'){
+            return cursor;
+        }
+    }
+    return begin;
+}
+
+}
+
+ScoreStats scoreCsvStream(const MappedModel& model, std::FILE* in, std::FILE* out, const ScoreOptions& options){
+    const LayerStack& layers = model.get_layers();
+    if(options.batch_rows == 0 || options.threads == 0 || options.block_bytes == 0){
+        throw std::invalid_argument("Batch rows, threads and block size must all be at least 1");
+    }
+    if(options.precision < 1 || options.precision > 17){
+        throw std::invalid_argument("Precision must be between 1 and 17 significant digits");
+    }
+    if(!options.class_names.empty() && options.class_names.size() != layers.output_size()){
+        throw std::invalid_argument("Expected " + std::to_string(layers.output_size()) + " class names, one per output of the model");
+    }
+
+    // Longest class token, the digits of a class index or a name, then one comma and a number in general format per output
+    std::size_t token_bytes = 10;
+    for(const std::string& name : options.class_names){
+        token_bytes = std::max(token_bytes, name.size());
+    }
+    ScoreContext ctx{model, options, layers.input_size(), layers.output_size(),
+                     token_bytes + 1 + (options.probabilities ? layers.output_size() * (options.precision + 10) : 0)};
+
+    unsigned int threads = options.threads;
+    std::unique_ptr<ThreadPool> pool;
+    if(threads > 1){
+        pool = std::make_unique<ThreadPool>(threads);
+    }
+
+    std::vector<ScoreShard> shards(threads);
+    for(ScoreShard& shard : shards){
+        shard.batch.resize(options.batch_rows, ctx.inputs);
+    }
+
+    std::vector<char> buffer(options.block_bytes * threads);
+    std::vector<const char*> boundaries(threads + 1);
+    std::size_t filled = 0;
+    std::size_t line_number = 1;
+    bool eof = false;
+
+    // Set while the rest of a line is dropped, the header or a line that does not fit in the buffer
+    bool skipping = options.skip_header;
+
+    ScoreStats stats;
+    while(true){
+        if(!eof){
+            filled += std::fread(buffer.data() + filled, 1, buffer.size() - filled, in);
+            if(filled < buffer.size()){
+                if(std::ferror(in)){
+                    throw std::runtime_error("Failed to read the measurements to score");
+                }
+                eof = true;
+            }
+        }
+
+        const char* begin = buffer.data();
+        const char* end = begin + filled;
+        if(skipping){
+            const char* newline = static_cast<const char*>(std::memchr(begin, '\n', filled));
+            if(newline == nullptr){
+                filled = 0;
+                if(eof){
+                    stats.lines++;
+                    break;
+                }
+                continue;
+            }
+            begin = newline + 1;
+            skipping = false;
+            line_number++;
+            stats.lines++;
+        }
+
+        // Only whole lines are scored, the start of an unfinished one waits for the next read
+        const char* cut = eof ? end : last_line_start(begin, end);
+        if(cut == buffer.data() && filled == buffer.size()){
+            report_error(stats.errors, stats.malformed_lines, line_number,
+                         "line is longer than the " + std::to_string(buffer.size()) + " byte input buffer");
+            skipping = true;
+            filled = 0;
+            continue;
+        }
+
+        // One piece per thread, each ending just past a newline
+        boundaries[0] = begin;
+        std::size_t piece_bytes = (cut - begin) / threads + 1;
+        for(unsigned int i = 1; i <= threads; i++){
+            const char* piece_end = std::min(cut, boundaries[i - 1] + piece_bytes);
+            if(piece_end < cut){
+                const char* newline = static_cast<const char*>(std::memchr(piece_end, '\n', cut - piece_end));
+                piece_end = newline ? newline + 1 : cut;
+            }
+            boundaries[i] = i == threads ? cut : piece_end;
+        }
+
+        auto score = [&](unsigned int i){ score_piece(ctx, shards[i], boundaries[i], boundaries[i + 1]); };
+        if(pool){
+            pool->parallel_for(threads, score);
+        } else {
+            score(0);
+        }
+
+        // Pieces are written and their errors numbered in input order
+        for(ScoreShard& shard : shards){
+            if(shard.output_size != 0 && std::fwrite(shard.output.data(), 1, shard.output_size, out) != shard.output_size){
+                throw std::runtime_error("Failed to write the scores");
+            }
+            for(CsvError& error : shard.errors){
+                if(stats.errors.size() == CsvBlock::MAX_REPORTED_ERRORS) break;
+                error.line += line_number - 1;
+                stats.errors.push_back(std::move(error));
+            }
+            stats.malformed_lines += shard.malformed_lines;
+            stats.rows += shard.scored;
+            stats.lines += shard.lines;
+            line_number += shard.lines;
+
+            shard.output_size = 0;
+            shard.errors.clear();
+            shard.malformed_lines = 0;
+            shard.scored = 0;
+            shard.lines = 0;
+        }
+
+        filled = end - cut;
+        if(eof && filled == 0){
+            break;
+        }
+        std::memmove(buffer.data(), cut, filled);
+    }
+
+    if(std::fflush(out) != 0){
+        throw std::runtime_error("Failed to write the scores");
+    }
+    return stats;
+}
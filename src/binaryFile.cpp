@@ -0,0 +1,91 @@
+// Prologue checks and the section writer shared by the binary file formats
+
+#include "binaryFile.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <system_error>
+
+static constexpr std::uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+BinaryFilePrologue makeFilePrologue(const char (&magic)[8], std::uint32_t version){
+    BinaryFilePrologue prologue{};
+    std::memcpy(prologue.magic, magic, sizeof(prologue.magic));
+    prologue.version = version;
+    prologue.byte_order = BYTE_ORDER_MARK;
+    return prologue;
+}
+
+bool filePrologueMatches(const BinaryFilePrologue& prologue, const char (&magic)[8], std::uint32_t version){
+    return std::memcmp(prologue.magic, magic, sizeof(prologue.magic)) == 0 && prologue.byte_order == BYTE_ORDER_MARK
+        && prologue.version == version;
+}
+
+const BinaryFilePrologue& checkFilePrologue(const MappedFile& file, const std::string& path, const char (&magic)[8],
+                                            std::uint32_t version, std::size_t header_size, const char* kind){
+    if(file.size() < header_size){
+        throw std::runtime_error(path + " is too small to be a " + kind + " file");
+    }
+
+    const BinaryFilePrologue& prologue = *reinterpret_cast<const BinaryFilePrologue*>(file.data());
+    if(std::memcmp(prologue.magic, magic, sizeof(prologue.magic)) != 0){
+        throw std::runtime_error(path + " is not a " + kind + " file");
+    }
+    if(prologue.byte_order != BYTE_ORDER_MARK){
+        throw std::runtime_error(path + " was written on a machine with a different byte order");
+    }
+    if(prologue.version != version){
+        throw std::runtime_error(path + " has " + kind + " file version " + std::to_string(prologue.version) + ", expected " + std::to_string(version));
+    }
+    if(prologue.file_size != file.size()){
+        throw std::runtime_error(path + " is truncated");
+    }
+    return prologue;
+}
+
+SectionWriter::SectionWriter(const std::string& path)
+    : path(path), temporary(path + ".tmp"), out(temporary, std::ios::binary | std::ios::trunc), position(0), committed(false) {
+    if(!out){
+        throw std::runtime_error("Could not create " + temporary);
+    }
+}
+
+SectionWriter::~SectionWriter(){
+    if(!committed){
+        out.close();
+        std::error_code error;
+        std::filesystem::remove(temporary, error);
+    }
+}
+
+void SectionWriter::append(const void* data, std::uint64_t bytes){
+    if(bytes == 0){
+        return;
+    }
+    out.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+    position += bytes;
+}
+
+void SectionWriter::write_block(std::uint64_t offset, const void* data, std::uint64_t bytes){
+    static const char zeros[SECTION_ALIGNMENT] = {};
+    while(position < offset){
+        std::uint64_t padding = std::min<std::uint64_t>(offset - position, SECTION_ALIGNMENT);
+        append(zeros, padding);
+    }
+    append(data, bytes);
+}
+
+void SectionWriter::commit(){
+    if(!out.flush()){
+        throw std::runtime_error("Could not write " + temporary);
+    }
+    out.close();
+
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if(error){
+        throw std::runtime_error("Could not replace " + path);
+    }
+    committed = true;
+}
@@ -1,122 +1,316 @@
 #include <iostream>
 #include <vector>
 #include <string>
-#include <fstream>
-#include <sstream>
-#include <vector>
+#include <string_view>
+#include <charconv>
+#include <cstring>
 #include <algorithm>
 #include <random>
+#include <stdexcept>
+#include <utility>
 #include "dataExtract.hpp"
+#include "mappedFile.hpp"
+#include "threadPool.hpp"
+#include "datasetFile.hpp"
+#include "profiler.hpp"
+
 
+// Bytes handed to parseCsvChunk at a time, each chunk is extended to the end of its last line
+static constexpr std::size_t CSV_CHUNK_BYTES = std::size_t(8) << 20;
+static constexpr std::size_t CSV_MIN_CHUNK_BYTES = std::size_t(1) << 20;
 
-std::vector<std::vector<Record>> getCsvData () {
-    std::ifstream file("data/iris.data");
+static bool is_blank(char c){
+    return c == ' ' || c == '\t' || c == '\r';
+}
 
-    // An array of all the the data point objects
-    Record * listDataPoints = new Record[150];
+// Strip spaces, tabs and a trailing carriage return from both ends of [begin, end)
+static void trim(const char*& begin, const char*& end){
+    while(begin < end && is_blank(*begin)) begin++;
+    while(end > begin && is_blank(end[-1])) end--;
+}
 
-    std::string line;
+static void report_error(CsvBlock& block, std::size_t line, std::string message){
+    if(block.errors.size() < CsvBlock::MAX_REPORTED_ERRORS){
+        block.errors.push_back(CsvError{line, std::move(message)});
+    }
+    block.malformed_lines++;
+}
 
-    // Tracks the current write entry of the array
-    unsigned int currentLine{};
+// ID of name within the block, new names are added in the order they appear
+static unsigned int intern_class(CsvBlock& block, std::string_view name){
+    for(std::size_t id{}; id < block.class_names.size(); id++){
+        if(block.class_names[id] == name){
+            return static_cast<unsigned int>(id);
+        }
+    }
+    block.class_names.emplace_back(name);
+    return static_cast<unsigned int>(block.class_names.size() - 1);
+}
 
-    // Until we hit the end of the file, access each line and populate the struct
-    while(std::getline(file, line)){
-        
-    
-        std::stringstream ss(line);
+// Parse one non-blank line in place and append its sample to block, returns false and fills message if it is malformed
+static bool parse_line(const char* begin, const char* end, CsvBlock& block, std::string& message){
+    double values[IRIS_FEATURES];
+    const char* field = begin;
 
-        std::string token;
-        std::vector<std::string> tokens;
+    for(unsigned int i{}; i < IRIS_FEATURES; i++){
+        const char* comma = static_cast<const char*>(std::memchr(field, ',', end - field));
+        if(comma == nullptr){
+            message = "expected 5 fields, found " + std::to_string(i + 1);
+            return false;
+        }
 
-        while(std::getline(ss, token, ',')) {
-            tokens.push_back(token);
+        const char* first = field;
+        const char* last = comma;
+        trim(first, last);
+        auto parsed = std::from_chars(first, last, values[i]);
+        if(first == last || parsed.ec != std::errc() || parsed.ptr != last){
+            message = "field " + std::to_string(i + 1) + " is not a number: '" + std::string(field, comma) + "'";
+            return false;
         }
+        field = comma + 1;
+    }
+
+    const char* name_begin = field;
+    const char* name_end = end;
+    trim(name_begin, name_end);
+    if(std::memchr(name_begin, ',', name_end - name_begin) != nullptr){
+        message = "too many fields";
+        return false;
+    }
+    if(name_begin == name_end){
+        message = "missing class name";
+        return false;
+    }
 
-        
-        
-    listDataPoints[currentLine].sepal_length = normalize_sepal_length(std::stod(tokens[0])); 
-    listDataPoints[currentLine].sepal_width = normalize_sepal_width(std::stod(tokens[1]));  
-    listDataPoints[currentLine].pedal_length = normalize_pedal_length(std::stod(tokens[2])); 
-    listDataPoints[currentLine].pedal_width = normalize_pedal_width(std::stod(tokens[3]));  
-    listDataPoints[currentLine].flower_type = tokens[4]; 
-    
-    if (listDataPoints[currentLine].flower_type == "Iris-setosa") {
-        listDataPoints[currentLine].one_hot[0] = 1.0;
-        listDataPoints[currentLine].one_hot[1] = 0.0;
-        listDataPoints[currentLine].one_hot[2] = 0.0;
-    } else if (listDataPoints[currentLine].flower_type == "Iris-versicolor") {
-        listDataPoints[currentLine].one_hot[0] = 0.0;
-        listDataPoints[currentLine].one_hot[1] = 1.0;
-        listDataPoints[currentLine].one_hot[2] = 0.0;
-    } else if (listDataPoints[currentLine].flower_type == "Iris-virginica") {
-        listDataPoints[currentLine].one_hot[0] = 0.0;
-        listDataPoints[currentLine].one_hot[1] = 0.0;
-        listDataPoints[currentLine].one_hot[2] = 1.0;
-    }
-
-    currentLine++;
-        
-    }
-
-    file.close();
+    block.features.insert(block.features.end(), values, values + IRIS_FEATURES);
+    block.labels.push_back(intern_class(block, std::string_view(name_begin, name_end - name_begin)));
+    return true;
+}
 
-    // The default iris dataset is ordered, so we need to shuffle it before splitting it into training and testing data
-    shuffleVector(listDataPoints, 150);
+std::size_t parseCsvChunk(const char* begin, const char* end, std::size_t first_line, CsvBlock& block){
+    std::size_t line_number = first_line;
+    std::string message;
+
+    while(begin < end){
+        const char* newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+        const char* line_end = newline ? newline : end;
+
+        const char* first = begin;
+        const char* last = line_end;
+        trim(first, last);
+        if(first != last && !parse_line(first, last, block, message)){
+            report_error(block, line_number, message);
+        }
+
+        line_number++;
+        begin = newline ? newline + 1 : end;
+    }
+
+    return line_number;
+}
+
+// Upper bound on the records in [begin, end), used to size a block before parsing it
+static std::size_t count_lines(const char* begin, const char* end){
+    std::size_t lines = 1;
+    while(const char* newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin))){
+        lines++;
+        begin = newline + 1;
+    }
+    return lines;
+}
+
+// Fold the chunk blocks, in file order, into one dataset whose class IDs follow the sorted class names
+// Sorting makes the IDs independent of which class happens to appear first in the file or in a chunk
+static CsvParseResult merge_blocks(std::vector<CsvBlock>& blocks, const std::vector<std::size_t>& first_lines){
+    CsvParseResult result;
+
+    std::vector<std::string> class_names;
+    std::size_t total_samples{};
+    for(const CsvBlock& block : blocks){
+        class_names.insert(class_names.end(), block.class_names.begin(), block.class_names.end());
+        total_samples += block.labels.size();
+    }
+    std::sort(class_names.begin(), class_names.end());
+    class_names.erase(std::unique(class_names.begin(), class_names.end()), class_names.end());
+
+    std::vector<double> features;
+    std::vector<unsigned int> labels;
+    features.reserve(total_samples * IRIS_FEATURES);
+    labels.reserve(total_samples);
+
+    std::vector<unsigned int> class_ids;
+    for(std::size_t i{}; i < blocks.size(); i++){
+        CsvBlock& block = blocks[i];
+
+        class_ids.clear();
+        for(const std::string& name : block.class_names){
+            class_ids.push_back(static_cast<unsigned int>(std::lower_bound(class_names.begin(), class_names.end(), name) - class_names.begin()));
+        }
+
+        features.insert(features.end(), block.features.begin(), block.features.end());
+        for(unsigned int label : block.labels){
+            labels.push_back(class_ids[label]);
+        }
 
-    std::vector<std::vector<Record>> result = splitData(120, 30, listDataPoints);
+        // Line numbers in a block count from its own first line
+        for(CsvError& error : block.errors){
+            if(result.errors.size() == CsvBlock::MAX_REPORTED_ERRORS) break;
+            error.line += first_lines[i] - 1;
+            result.errors.push_back(std::move(error));
+        }
+        result.malformed_lines += block.malformed_lines;
 
-    // Free the heap memory
-    delete[] listDataPoints;
+        // Release the block right away so the peak footprint stays near one copy of the data
+        block = CsvBlock();
+    }
 
-    // Return the vector containing the training and testing data
+    result.data = Dataset(IRIS_FEATURES, std::move(features), std::move(labels), std::move(class_names));
     return result;
 }
 
-// Returns a vector containing two vectors, the first being the training data and the second being the testing data
-std::vector<std::vector<Record>> splitData(int trainNum, int testNum, Record* dataPoints) {
+CsvParseResult readCsvDataset(const std::string& path, unsigned int num_threads){
+    MappedFile file(path);
+    file.advise_sequential();
 
-    // The vector is going to hold the training data vector at index 0 and the testing data vector at index 1
-    std::vector<std::vector<Record>> array(2);
+    const char* begin = file.data();
+    const char* end = begin + file.size();
+    if(num_threads == 0) num_threads = 1;
 
-    array[0] = std::vector<Record>(trainNum);
-    for(int i{}; i < trainNum; i++) {
-        array[0][i] = dataPoints[i];
+    // Aim for a few chunks per thread so uneven lines still balance, without going below 1 MB per chunk
+    std::size_t chunk_bytes = CSV_CHUNK_BYTES;
+    if(num_threads > 1){
+        chunk_bytes = std::max(CSV_MIN_CHUNK_BYTES, std::min(CSV_CHUNK_BYTES, file.size() / (num_threads * 4)));
     }
 
-    array[1] = std::vector<Record>(testNum);
-    for(int i{}; i < testNum; i++) {
-        array[1][i] = dataPoints[i + trainNum];
+    // Chunks always end just past a newline so no line is split between two of them
+    std::vector<const char*> boundaries{begin};
+    while(boundaries.back() < end){
+        const char* cursor = boundaries.back();
+        const char* chunk_end = cursor + std::min<std::size_t>(chunk_bytes, end - cursor);
+        if(chunk_end < end){
+            const char* newline = static_cast<const char*>(std::memchr(chunk_end, '\n', end - chunk_end));
+            chunk_end = newline ? newline + 1 : end;
+        }
+        boundaries.push_back(chunk_end);
     }
 
-    return array;
-}   
+    // Every chunk is parsed into its own columnar block with line numbers counted from the start of the chunk
+    unsigned int chunk_count = static_cast<unsigned int>(boundaries.size() - 1);
+    std::vector<CsvBlock> blocks(chunk_count);
+    std::vector<std::size_t> line_counts(chunk_count);
+    auto parse_block = [&](unsigned int i){
+        std::size_t lines = count_lines(boundaries[i], boundaries[i + 1]);
+        blocks[i].features.reserve(lines * IRIS_FEATURES);
+        blocks[i].labels.reserve(lines);
+        line_counts[i] = parseCsvChunk(boundaries[i], boundaries[i + 1], 1, blocks[i]) - 1;
+    };
 
-// Shuffles the data points in the array since be default the Iris data is structured in an ordered way
-void shuffleVector(Record * dataPoints, int size) {
+    unsigned int threads = std::min(num_threads, chunk_count);
+    if(threads > 1){
+        ThreadPool pool(threads);
+        pool.parallel_for(chunk_count, parse_block);
+    } else {
+        for(unsigned int i{}; i < chunk_count; i++){
+            parse_block(i);
+        }
+    }
 
-    // 42 for the memes and the funnies 
-    std::mt19937 seedValue(42);
+    std::vector<std::size_t> first_lines(chunk_count);
+    std::size_t line_number = 1;
+    for(unsigned int i{}; i < chunk_count; i++){
+        first_lines[i] = line_number;
+        line_number += line_counts[i];
+    }
 
-    // Shuffle the vector
-    std::shuffle(dataPoints, dataPoints + size, seedValue);
+    // Merging in chunk order keeps the samples exactly as they appear in the file
+    return merge_blocks(blocks, first_lines);
 }
 
+std::string datasetCachePath(const std::string& csv_path){
+    return csv_path + ".bin";
+}
 
-double normalize_pedal_length(double value){
-    return ((value - 1.0) / 5.9);
+CsvParseResult convertCsvToDatasetFile(const std::string& csv_path, const std::string& dataset_path, unsigned int num_threads){
+    // Stamp the source before reading it, so a change made while parsing leaves a stale cache rather than a wrong one
+    SourceStamp source = sourceStampOf(csv_path);
+    CsvParseResult parsed = readCsvDataset(csv_path, num_threads);
+    writeDatasetFile(dataset_path, parsed.data, source);
+    return parsed;
 }
 
-double normalize_pedal_width(double value){
-    return ((value - 0.1) / 2.4);
+CsvParseResult loadCsvDataset(const std::string& csv_path, unsigned int num_threads){
+    std::string cache_path = datasetCachePath(csv_path);
+    SourceStamp source = sourceStampOf(csv_path);
+
+    SourceStamp cached;
+    if(readDatasetFileStamp(cache_path, cached) && cached == source){
+        try {
+            LoadedDataset loaded = loadDatasetFile(cache_path);
+            CsvParseResult result;
+            result.data = std::move(loaded.data);
+            result.from_cache = true;
+            return result;
+        } catch(const std::runtime_error&){
+            // A damaged cache is rebuilt below like a stale one
+        }
+    }
+
+    CsvParseResult parsed = readCsvDataset(csv_path, num_threads);
+    try {
+        writeDatasetFile(cache_path, parsed.data, source);
+    } catch(const std::runtime_error&){
+        // The cache only saves time, a read-only data directory just means parsing again next time
+    }
+    return parsed;
 }
 
-double normalize_sepal_length(double value){
-    return ((value - 4.3) / 3.6);
+DataSplit getCsvData(const std::string& path, unsigned int num_threads, NormalizationMethod method) {
+    IRIS_PROFILE_SCOPE(ProfilePhase::DataLoad);
+    CsvParseResult parsed = loadCsvDataset(path, num_threads);
+
+    for(const CsvError& error : parsed.errors){
+        std::cerr << path << ":" << error.line << ": " << error.message << std::endl;
+    }
+    if(parsed.malformed_lines > parsed.errors.size()){
+        std::cerr << path << ": " << parsed.malformed_lines - parsed.errors.size() << " more malformed lines" << std::endl;
+    }
+
+    // The default iris dataset is ordered, so we need to shuffle it before splitting it into training and testing data
+    shuffleDataset(parsed.data);
+
+    // 80% training, which is the original 120 / 30 split for the 150 iris samples
+    std::size_t trainNum = parsed.data.size() * 4 / 5;
+
+    // Only the training samples are looked at to fit the normalization, the test samples just have it applied
+    Normalizer normalizer;
+    if(trainNum > 0){
+        normalizer = Normalizer::fit(parsed.data.slice(0, trainNum), method);
+        normalizer.apply(parsed.data);
+    }
+
+    DataSplit split = splitData(std::move(parsed.data), trainNum);
+    split.normalizer = std::move(normalizer);
+    return split;
 }
 
-double normalize_sepal_width(double value){
-    return ((value - 2.0) / 2.4);
+// Views of the first trainNum samples as the training data and the rest as the testing data, nothing is copied
+DataSplit splitData(Dataset data, std::size_t trainNum) {
+    if(trainNum > data.size()){
+        throw std::invalid_argument("More training samples requested than the dataset holds");
+    }
+
+    DataSplit split;
+    split.data = std::move(data);
+    split.training = split.data.slice(0, trainNum);
+    split.testing = split.data.slice(trainNum, split.data.size() - trainNum);
+    return split;
 }
 
+// Shuffles the samples since be default the Iris data is structured in an ordered way
+void shuffleDataset(Dataset& data) {
 
+    // 42 for the memes and the funnies 
+    std::mt19937 seedValue(42);
+
+    data.shuffle(seedValue);
+}
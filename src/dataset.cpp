@@ -0,0 +1,143 @@
+// Columnar dataset storage and zero-copy views
+
+#include "dataset.hpp"
+#include "mappedFile.hpp"
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+
+DatasetView::DatasetView()
+    : feature_data(nullptr), target_data(nullptr), label_data(nullptr), rows(0), feature_count(0), class_count(0) {
+}
+
+MatrixView DatasetView::features() const {
+    return MatrixView(feature_data, static_cast<unsigned int>(rows), feature_count);
+}
+
+MatrixView DatasetView::targets() const {
+    return MatrixView(target_data, static_cast<unsigned int>(rows), class_count);
+}
+
+DatasetView DatasetView::slice(std::size_t start, std::size_t count) const {
+    if(start > rows || count > rows - start){
+        throw std::out_of_range("Dataset slice is out of range");
+    }
+
+    DatasetView result = *this;
+    result.feature_data = feature_data + start * feature_count;
+    result.target_data = target_data + start * class_count;
+    result.label_data = label_data + start;
+    result.rows = count;
+    return result;
+}
+
+Dataset::Dataset()
+    : feature_count(0), sample_count(0), feature_data(nullptr), label_data(nullptr) {
+}
+
+Dataset::Dataset(unsigned int num_features, std::vector<double> feature_values, std::vector<unsigned int> label_values, std::vector<std::string> names)
+    : feature_count(num_features), sample_count(label_values.size()), features(std::move(feature_values)), labels(std::move(label_values)),
+      class_names(std::move(names)) {
+
+    if(features.size() != labels.size() * feature_count){
+        throw std::invalid_argument("Feature count does not match the number of labels");
+    }
+
+    feature_data = features.data();
+    label_data = labels.data();
+    build_targets();
+}
+
+Dataset::Dataset(unsigned int num_features, std::shared_ptr<const MappedFile> file, const double* feature_values, const unsigned int* label_values,
+                 std::size_t count, std::vector<std::string> names)
+    : feature_count(num_features), sample_count(count), feature_data(feature_values), label_data(label_values),
+      mapping(std::move(file)), class_names(std::move(names)) {
+
+    build_targets();
+}
+
+// Moving the vectors keeps their buffers, so the data pointers stay valid, the source is left empty
+Dataset::Dataset(Dataset&& other) noexcept
+    : Dataset() {
+    *this = std::move(other);
+}
+
+Dataset& Dataset::operator=(Dataset&& other) noexcept {
+    if(this != &other){
+        feature_count = other.feature_count;
+        sample_count = other.sample_count;
+        feature_data = other.feature_data;
+        label_data = other.label_data;
+        features = std::move(other.features);
+        labels = std::move(other.labels);
+        mapping = std::move(other.mapping);
+        targets = std::move(other.targets);
+        class_names = std::move(other.class_names);
+
+        other.feature_count = 0;
+        other.sample_count = 0;
+        other.feature_data = nullptr;
+        other.label_data = nullptr;
+    }
+    return *this;
+}
+
+void Dataset::build_targets(){
+    std::size_t classes = class_names.size();
+    targets.assign(sample_count * classes, 0.0);
+    for(std::size_t i{}; i < sample_count; i++){
+        if(label_data[i] >= classes){
+            throw std::invalid_argument("Label has no class name");
+        }
+        targets[i * classes + label_data[i]] = 1.0;
+    }
+}
+
+DatasetView Dataset::view() const {
+    DatasetView result;
+    result.feature_data = feature_data;
+    result.target_data = targets.data();
+    result.label_data = label_data;
+    result.rows = sample_count;
+    result.feature_count = feature_count;
+    result.class_count = num_classes();
+    return result;
+}
+
+double* Dataset::mutable_features(){
+    if(mapping){
+        features.assign(feature_data, feature_data + sample_count * feature_count);
+        labels.assign(label_data, label_data + sample_count);
+        feature_data = features.data();
+        label_data = labels.data();
+        mapping.reset();
+    }
+    return features.data();
+}
+
+void Dataset::shuffle(std::mt19937& engine){
+    // Shuffling the sample indices consumes the engine exactly like shuffling the samples themselves
+    std::vector<std::size_t> order(size());
+    std::iota(order.begin(), order.end(), std::size_t(0));
+    std::shuffle(order.begin(), order.end(), engine);
+
+    std::size_t classes = num_classes();
+    std::vector<double> shuffled_features(sample_count * feature_count);
+    std::vector<double> shuffled_targets(targets.size());
+    std::vector<unsigned int> shuffled_labels(sample_count);
+
+    for(std::size_t i{}; i < order.size(); i++){
+        std::size_t from = order[i];
+        std::copy_n(feature_data + from * feature_count, feature_count, shuffled_features.data() + i * feature_count);
+        std::copy_n(targets.data() + from * classes, classes, shuffled_targets.data() + i * classes);
+        shuffled_labels[i] = label_data[from];
+    }
+
+    features = std::move(shuffled_features);
+    targets = std::move(shuffled_targets);
+    labels = std::move(shuffled_labels);
+    feature_data = features.data();
+    label_data = labels.data();
+    mapping.reset();
+}
@@ -0,0 +1,171 @@
+// Binary dataset files that are memory-mapped straight into a Dataset
+
+#include "datasetFile.hpp"
+#include "binaryFile.hpp"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+static constexpr char DATASET_FILE_MAGIC[8] = {'I', 'R', 'I', 'S', 'D', 'A', 'T', 'A'};
+
+// Fixed-size header at the start of the file, all offsets are in bytes from the start of the file
+struct DatasetFileHeader {
+    BinaryFilePrologue prologue;
+
+    std::uint64_t num_samples;
+    std::uint32_t num_features;
+    std::uint32_t num_classes;
+
+    std::uint64_t source_size;
+    std::int64_t source_modified;
+
+    // num_samples x num_features doubles, row-major
+    std::uint64_t features_offset;
+
+    // num_samples uint32 class IDs
+    std::uint64_t labels_offset;
+
+    // num_classes names, each a uint32 length followed by its bytes
+    std::uint64_t names_offset;
+};
+
+SourceStamp sourceStampOf(const std::string& path){
+    std::error_code error;
+    SourceStamp stamp;
+    stamp.size = std::filesystem::file_size(path, error);
+    if(error){
+        throw std::runtime_error("Could not read the size of " + path);
+    }
+
+    auto modified = std::filesystem::last_write_time(path, error);
+    if(error){
+        throw std::runtime_error("Could not read the modification time of " + path);
+    }
+    stamp.modified = static_cast<std::int64_t>(modified.time_since_epoch().count());
+    return stamp;
+}
+
+void writeDatasetFile(const std::string& path, const Dataset& data, const SourceStamp& source){
+    DatasetFileHeader header{};
+    header.prologue = makeFilePrologue(DATASET_FILE_MAGIC, DATASET_FILE_VERSION);
+    header.num_samples = data.size();
+    header.num_features = data.num_features();
+    header.num_classes = data.num_classes();
+    header.source_size = source.size;
+    header.source_modified = source.modified;
+
+    header.features_offset = alignSection(sizeof(DatasetFileHeader));
+    header.labels_offset = alignSection(header.features_offset + header.num_samples * header.num_features * sizeof(double));
+    header.names_offset = alignSection(header.labels_offset + header.num_samples * sizeof(std::uint32_t));
+
+    std::uint64_t names_bytes{};
+    for(const std::string& name : data.get_class_names()){
+        names_bytes += sizeof(std::uint32_t) + name.size();
+    }
+    header.prologue.file_size = header.names_offset + names_bytes;
+
+    DatasetView all = data.view();
+    SectionWriter out(path);
+    out.append(&header, sizeof(header));
+    out.write_block(header.features_offset, all.feature_row(0), all.size() * all.num_features() * sizeof(double));
+
+    static_assert(sizeof(unsigned int) == sizeof(std::uint32_t), "Class IDs are stored as 32-bit values");
+    out.write_block(header.labels_offset, all.labels(), all.size() * sizeof(std::uint32_t));
+
+    out.write_block(header.names_offset, nullptr, 0);
+    for(const std::string& name : data.get_class_names()){
+        std::uint32_t length = static_cast<std::uint32_t>(name.size());
+        out.append(&length, sizeof(length));
+        out.append(name.data(), name.size());
+    }
+    out.commit();
+}
+
+// The prologue check and the checks of this format's own header, before anything inside the file is trusted
+static const DatasetFileHeader& checked_header(const MappedFile& file, const std::string& path){
+    checkFilePrologue(file, path, DATASET_FILE_MAGIC, DATASET_FILE_VERSION, sizeof(DatasetFileHeader), "dataset");
+    const DatasetFileHeader& header = *reinterpret_cast<const DatasetFileHeader*>(file.data());
+    std::uint64_t file_size = header.prologue.file_size;
+
+    // Bounding the counts by the file size keeps the block sizes below from overflowing
+    std::uint64_t max_values = file_size / sizeof(double);
+    if(header.num_features > max_values || header.num_classes > file_size
+       || (header.num_features != 0 && header.num_samples > max_values / header.num_features)
+       || header.num_samples > file_size / sizeof(std::uint32_t)){
+        throw std::runtime_error(path + " has a corrupt header");
+    }
+
+    // Sections have to be aligned, inside the file and in order
+    std::uint64_t features_bytes = header.num_samples * header.num_features * sizeof(double);
+    std::uint64_t labels_bytes = header.num_samples * sizeof(std::uint32_t);
+    bool aligned = header.features_offset % SECTION_ALIGNMENT == 0 && header.labels_offset % SECTION_ALIGNMENT == 0;
+    bool inside = sectionInFile(header.features_offset, features_bytes, file_size)
+               && sectionInFile(header.labels_offset, labels_bytes, file_size)
+               && sectionInFile(header.names_offset, 0, file_size);
+    bool ordered = inside && header.features_offset >= sizeof(DatasetFileHeader)
+                && header.labels_offset >= header.features_offset + features_bytes
+                && header.names_offset >= header.labels_offset + labels_bytes;
+    if(!aligned || !ordered){
+        throw std::runtime_error(path + " has a corrupt section table");
+    }
+
+    return header;
+}
+
+bool readDatasetFileStamp(const std::string& path, SourceStamp& source){
+    std::ifstream in(path, std::ios::binary);
+    DatasetFileHeader header;
+    if(!in.read(reinterpret_cast<char*>(&header), sizeof(header))){
+        return false;
+    }
+
+    if(!filePrologueMatches(header.prologue, DATASET_FILE_MAGIC, DATASET_FILE_VERSION)){
+        return false;
+    }
+
+    source.size = header.source_size;
+    source.modified = header.source_modified;
+    return true;
+}
+
+LoadedDataset loadDatasetFile(const std::string& path){
+    auto file = std::make_shared<MappedFile>(path);
+    const DatasetFileHeader& header = checked_header(*file, path);
+    const char* base = file->data();
+
+    LoadedDataset result;
+    result.source.size = header.source_size;
+    result.source.modified = header.source_modified;
+
+    std::vector<std::string> class_names;
+    const char* cursor = base + header.names_offset;
+    const char* end = base + header.prologue.file_size;
+    for(std::uint32_t i{}; i < header.num_classes; i++){
+        std::uint32_t length;
+        if(end - cursor < static_cast<std::ptrdiff_t>(sizeof(length))){
+            throw std::runtime_error(path + " has a truncated class name table");
+        }
+        std::memcpy(&length, cursor, sizeof(length));
+        cursor += sizeof(length);
+        if(static_cast<std::uint64_t>(end - cursor) < length){
+            throw std::runtime_error(path + " has a truncated class name table");
+        }
+        class_names.emplace_back(cursor, length);
+        cursor += length;
+    }
+
+    const double* features = reinterpret_cast<const double*>(base + header.features_offset);
+    const unsigned int* labels = reinterpret_cast<const unsigned int*>(base + header.labels_offset);
+
+    // Labels outside the class table make the Dataset constructor throw, which also catches a corrupt label block
+    try {
+        result.data = Dataset(header.num_features, std::move(file), features, labels, header.num_samples, std::move(class_names));
+    } catch(const std::invalid_argument&){
+        throw std::runtime_error(path + " has class IDs without a class name");
+    }
+    return result;
+}
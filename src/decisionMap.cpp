@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include "decisionMap.hpp"
+
+namespace {
+
+// Grid points run through the network at a time
+constexpr unsigned int BATCH_ROWS = 1024;
+
+struct Rgb {
+    double r, g, b;
+};
+
+// Class colors, a pixel mixes them by the predicted probabilities, class c uses entry c modulo the palette size
+const Rgb PALETTE[] = {
+    {255, 140, 0}, {40, 130, 255}, {70, 200, 90}, {220, 60, 160}, {230, 220, 60}, {60, 210, 220}
+};
+constexpr std::size_t PALETTE_SIZE = sizeof(PALETTE) / sizeof(PALETTE[0]);
+
+// Unevaluated pixels and regions the network is unsure about fade towards the visualizer's background
+const Rgb BACKGROUND = {30, 30, 30};
+
+std::uint8_t channel(double value){
+    return static_cast<std::uint8_t>(std::min(255.0, std::max(0.0, value + 0.5)));
+}
+
+}
+
+DecisionMap::DecisionMap(const LayerStack& layers, const DatasetView& samples, unsigned int width, unsigned int height)
+    : layers(layers), image_width(width), image_height(height), image(std::size_t(width) * height * 4),
+      feature_x(0), feature_y(1), parameters(1, static_cast<unsigned int>(layers.parameter_count()), 0.0),
+      level_step(COARSEST_STEP), next_point(0), batch_pixels(BATCH_ROWS), batch_rows(0) {
+    unsigned int inputs = layers.input_size();
+    if(width == 0 || height == 0){
+        throw std::invalid_argument("A decision map needs at least one pixel");
+    }
+    if(inputs < 2){
+        throw std::invalid_argument("A decision map needs a network with at least two inputs");
+    }
+    if(samples.empty() || samples.num_features() != inputs){
+        throw std::invalid_argument("A decision map needs samples with one feature per input of the network");
+    }
+
+    lower.assign(inputs, 0.0);
+    upper.assign(inputs, 0.0);
+    means.assign(inputs, 0.0);
+    for(unsigned int f = 0; f < inputs; f++){
+        lower[f] = upper[f] = samples.feature_row(0)[f];
+    }
+    for(std::size_t i = 0; i < samples.size(); i++){
+        const double* row = samples.feature_row(i);
+        for(unsigned int f = 0; f < inputs; f++){
+            lower[f] = std::min(lower[f], row[f]);
+            upper[f] = std::max(upper[f], row[f]);
+            means[f] += row[f];
+        }
+    }
+    for(unsigned int f = 0; f < inputs; f++){
+        means[f] /= samples.size();
+        double margin = upper[f] > lower[f] ? (upper[f] - lower[f]) * 0.1 : 0.5;
+        lower[f] -= margin;
+        upper[f] += margin;
+    }
+
+    for(std::size_t i = 0; i < image.size(); i += 4){
+        image[i] = channel(BACKGROUND.r);
+        image[i + 1] = channel(BACKGROUND.g);
+        image[i + 2] = channel(BACKGROUND.b);
+        image[i + 3] = 255;
+    }
+
+    batch.resize(BATCH_ROWS, inputs);
+    set_axes(0, 1);
+}
+
+void DecisionMap::set_axes(unsigned int x, unsigned int y){
+    unsigned int inputs = layers.input_size();
+    if(x >= inputs || y >= inputs || x == y){
+        throw std::invalid_argument("The axes of a decision map must be two different inputs of the network");
+    }
+    feature_x = x;
+    feature_y = y;
+
+    // Every queued row starts at the means, only the two axis inputs are written per point
+    for(unsigned int r = 0; r < BATCH_ROWS; r++){
+        std::memcpy(batch.data() + std::size_t(r) * inputs, means.data(), inputs * sizeof(double));
+    }
+
+    level_step = COARSEST_STEP;
+    next_point = 0;
+    batch_rows = 0;
+}
+
+void DecisionMap::restart(const double* values){
+    std::memcpy(parameters.data(), values, parameters.size() * sizeof(double));
+    level_step = COARSEST_STEP;
+    next_point = 0;
+    batch_rows = 0;
+}
+
+void DecisionMap::class_color(unsigned int c, std::uint8_t rgb[3]){
+    const Rgb& color = PALETTE[c % PALETTE_SIZE];
+    rgb[0] = channel(color.r);
+    rgb[1] = channel(color.g);
+    rgb[2] = channel(color.b);
+}
+
+bool DecisionMap::evaluated_before(unsigned int x, unsigned int y) const {
+    return level_step != COARSEST_STEP && x % (2 * level_step) == 0 && y % (2 * level_step) == 0;
+}
+
+bool DecisionMap::advance(std::size_t max_points){
+    unsigned int inputs = layers.input_size();
+    double x_scale = (upper[feature_x] - lower[feature_x]) / image_width;
+    double y_scale = (upper[feature_y] - lower[feature_y]) / image_height;
+
+    bool changed = false;
+    std::size_t evaluated = 0;
+    while(level_step != 0 && evaluated < max_points){
+        unsigned int columns = level_columns();
+        std::size_t count = std::size_t(columns) * level_rows();
+
+        while(next_point < count && evaluated < max_points){
+            unsigned int x = static_cast<unsigned int>(next_point % columns) * level_step;
+            unsigned int y = static_cast<unsigned int>(next_point / columns) * level_step;
+            next_point++;
+            if(evaluated_before(x, y)){
+                continue;
+            }
+
+            // Each point stands for the centre of its pixel, the top row of the image is the top of the y range
+            double* row = batch.data() + std::size_t(batch_rows) * inputs;
+            row[feature_x] = lower[feature_x] + (x + 0.5) * x_scale;
+            row[feature_y] = upper[feature_y] - (y + 0.5) * y_scale;
+            batch_pixels[batch_rows++] = y * image_width + x;
+            evaluated++;
+
+            if(batch_rows == BATCH_ROWS){
+                evaluate_batch();
+                changed = true;
+            }
+        }
+
+        // Queued points paint tiles of the level they were queued on, so they go through before the step shrinks
+        if(next_point == count){
+            if(batch_rows != 0){
+                evaluate_batch();
+                changed = true;
+            }
+            level_step /= 2;
+            next_point = 0;
+        }
+    }
+
+    if(batch_rows != 0){
+        evaluate_batch();
+        changed = true;
+    }
+    return changed;
+}
+
+void DecisionMap::evaluate_batch(){
+    unsigned int inputs = layers.input_size();
+    unsigned int classes = layers.output_size();
+    layers.forward(MatrixView(batch.data(), batch_rows, inputs), parameters.data(), ws);
+    MatrixView output = ws.output();
+
+    for(unsigned int r = 0; r < batch_rows; r++){
+        const double* scores = output.row(r);
+
+        // Sigmoid outputs do not sum to one, so every output layer is normalized the same way
+        double total = 0.0;
+        double best = 0.0;
+        for(unsigned int c = 0; c < classes; c++){
+            total += std::max(0.0, scores[c]);
+            best = std::max(best, scores[c]);
+        }
+
+        Rgb color = BACKGROUND;
+        if(total > 0.0){
+            Rgb mixed = {0.0, 0.0, 0.0};
+            for(unsigned int c = 0; c < classes; c++){
+                double weight = std::max(0.0, scores[c]) / total;
+                mixed.r += weight * PALETTE[c % PALETTE_SIZE].r;
+                mixed.g += weight * PALETTE[c % PALETTE_SIZE].g;
+                mixed.b += weight * PALETTE[c % PALETTE_SIZE].b;
+            }
+
+            // Confidence 0 when every class is equally likely, 1 when one class takes everything
+            double confidence = classes > 1 ? (best / total * classes - 1.0) / (classes - 1) : 1.0;
+            double strength = 0.35 + 0.65 * confidence;
+            color.r += (mixed.r - color.r) * strength;
+            color.g += (mixed.g - color.g) * strength;
+            color.b += (mixed.b - color.b) * strength;
+        }
+
+        std::uint8_t pixel[4] = {channel(color.r), channel(color.g), channel(color.b), 255};
+        unsigned int x0 = batch_pixels[r] % image_width;
+        unsigned int y0 = batch_pixels[r] / image_width;
+        unsigned int x1 = std::min(image_width, x0 + level_step);
+        unsigned int y1 = std::min(image_height, y0 + level_step);
+        for(unsigned int y = y0; y < y1; y++){
+            std::uint8_t* out = image.data() + (std::size_t(y) * image_width + x0) * 4;
+            for(unsigned int x = x0; x < x1; x++, out += 4){
+                std::memcpy(out, pixel, 4);
+            }
+        }
+    }
+    batch_rows = 0;
+}
@@ -0,0 +1,403 @@
+// Cache-blocked GEMM with AVX2 / AVX-512 micro-kernels and a portable scalar fallback
+//
+// The loop structure follows the usual Goto/BLIS layout: op(B) is packed into KC x NC panels that stay in L3/L2,
+// op(A) is packed into MC x KC blocks that stay in L2, and a register-blocked MR x NR micro-kernel streams through
+// both packed buffers. Transposed operands are handled while packing, so the kernels only ever see one layout.
+
+#include "gemm.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if IRIS_SIMD_X86 && defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
+namespace {
+
+// Blocking sizes in elements, KC * NR doubles of B plus MR * KC of A fit comfortably in L1
+const unsigned int KC = 256;
+const unsigned int MC = 96;
+const unsigned int NC = 2048;
+
+// Problems with fewer multiply-adds than this skip packing entirely, e.g. the per-sample 1 x 4 * 4 x 5 products
+const std::uint64_t SMALL_GEMM_WORK = 4096;
+
+typedef void (*MicroKernel)(unsigned int kc, const double* a, const double* b, double* c, unsigned int ldc,
+                            double alpha, unsigned int rows, unsigned int cols);
+
+struct KernelInfo {
+    unsigned int mr;
+    unsigned int nr;
+    MicroKernel micro;
+};
+
+// Scalar micro-kernel, accumulates each entry over k in order so small problems match the textbook loop exactly
+const unsigned int SCALAR_MR = 4;
+const unsigned int SCALAR_NR = 4;
+
+void micro_scalar(unsigned int kc, const double* a, const double* b, double* c, unsigned int ldc,
+                  double alpha, unsigned int rows, unsigned int cols){
+    double acc[SCALAR_MR][SCALAR_NR] = {};
+
+    for(unsigned int p = 0; p < kc; p++){
+        const double* a_col = a + p * SCALAR_MR;
+        const double* b_row = b + p * SCALAR_NR;
+        for(unsigned int r = 0; r < SCALAR_MR; r++){
+            for(unsigned int j = 0; j < SCALAR_NR; j++){
+                acc[r][j] += a_col[r] * b_row[j];
+            }
+        }
+    }
+
+    for(unsigned int r = 0; r < rows; r++){
+        for(unsigned int j = 0; j < cols; j++){
+            c[r * ldc + j] += alpha * acc[r][j];
+        }
+    }
+}
+
+#if IRIS_SIMD_X86
+
+// AVX2 + FMA micro-kernel, a 6 x 8 tile of C held in 12 ymm registers
+const unsigned int AVX2_MR = 6;
+const unsigned int AVX2_NR = 8;
+
+IRIS_TARGET("avx2,fma")
+void micro_avx2(unsigned int kc, const double* a, const double* b, double* c, unsigned int ldc,
+                double alpha, unsigned int rows, unsigned int cols){
+    __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+    __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+    __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+    __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+    __m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd();
+    __m256d c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
+
+    for(unsigned int p = 0; p < kc; p++){
+        __m256d b0 = _mm256_loadu_pd(b);
+        __m256d b1 = _mm256_loadu_pd(b + 4);
+        __m256d ar;
+
+        ar = _mm256_broadcast_sd(a + 0); c00 = _mm256_fmadd_pd(ar, b0, c00); c01 = _mm256_fmadd_pd(ar, b1, c01);
+        ar = _mm256_broadcast_sd(a + 1); c10 = _mm256_fmadd_pd(ar, b0, c10); c11 = _mm256_fmadd_pd(ar, b1, c11);
+        ar = _mm256_broadcast_sd(a + 2); c20 = _mm256_fmadd_pd(ar, b0, c20); c21 = _mm256_fmadd_pd(ar, b1, c21);
+        ar = _mm256_broadcast_sd(a + 3); c30 = _mm256_fmadd_pd(ar, b0, c30); c31 = _mm256_fmadd_pd(ar, b1, c31);
+        ar = _mm256_broadcast_sd(a + 4); c40 = _mm256_fmadd_pd(ar, b0, c40); c41 = _mm256_fmadd_pd(ar, b1, c41);
+        ar = _mm256_broadcast_sd(a + 5); c50 = _mm256_fmadd_pd(ar, b0, c50); c51 = _mm256_fmadd_pd(ar, b1, c51);
+
+        a += AVX2_MR;
+        b += AVX2_NR;
+    }
+
+    __m256d tile[AVX2_MR][2] = {{c00, c01}, {c10, c11}, {c20, c21}, {c30, c31}, {c40, c41}, {c50, c51}};
+    __m256d alpha_v = _mm256_set1_pd(alpha);
+
+    if(rows == AVX2_MR && cols == AVX2_NR){
+        for(unsigned int r = 0; r < AVX2_MR; r++){
+            double* c_row = c + r * ldc;
+            _mm256_storeu_pd(c_row,     _mm256_fmadd_pd(alpha_v, tile[r][0], _mm256_loadu_pd(c_row)));
+            _mm256_storeu_pd(c_row + 4, _mm256_fmadd_pd(alpha_v, tile[r][1], _mm256_loadu_pd(c_row + 4)));
+        }
+        return;
+    }
+
+    // Edge tile, spill the registers and only touch the entries that exist
+    alignas(32) double spill[AVX2_MR * AVX2_NR];
+    for(unsigned int r = 0; r < AVX2_MR; r++){
+        _mm256_store_pd(spill + r * AVX2_NR,     tile[r][0]);
+        _mm256_store_pd(spill + r * AVX2_NR + 4, tile[r][1]);
+    }
+    for(unsigned int r = 0; r < rows; r++){
+        for(unsigned int j = 0; j < cols; j++){
+            c[r * ldc + j] += alpha * spill[r * AVX2_NR + j];
+        }
+    }
+}
+
+// AVX-512 micro-kernel, an 8 x 16 tile of C held in 16 zmm registers
+const unsigned int AVX512_MR = 8;
+const unsigned int AVX512_NR = 16;
+
+IRIS_TARGET("avx512f")
+void micro_avx512(unsigned int kc, const double* a, const double* b, double* c, unsigned int ldc,
+                  double alpha, unsigned int rows, unsigned int cols){
+    __m512d c00 = _mm512_setzero_pd(), c01 = _mm512_setzero_pd();
+    __m512d c10 = _mm512_setzero_pd(), c11 = _mm512_setzero_pd();
+    __m512d c20 = _mm512_setzero_pd(), c21 = _mm512_setzero_pd();
+    __m512d c30 = _mm512_setzero_pd(), c31 = _mm512_setzero_pd();
+    __m512d c40 = _mm512_setzero_pd(), c41 = _mm512_setzero_pd();
+    __m512d c50 = _mm512_setzero_pd(), c51 = _mm512_setzero_pd();
+    __m512d c60 = _mm512_setzero_pd(), c61 = _mm512_setzero_pd();
+    __m512d c70 = _mm512_setzero_pd(), c71 = _mm512_setzero_pd();
+
+    for(unsigned int p = 0; p < kc; p++){
+        __m512d b0 = _mm512_loadu_pd(b);
+        __m512d b1 = _mm512_loadu_pd(b + 8);
+        __m512d ar;
+
+        ar = _mm512_set1_pd(a[0]); c00 = _mm512_fmadd_pd(ar, b0, c00); c01 = _mm512_fmadd_pd(ar, b1, c01);
+        ar = _mm512_set1_pd(a[1]); c10 = _mm512_fmadd_pd(ar, b0, c10); c11 = _mm512_fmadd_pd(ar, b1, c11);
+        ar = _mm512_set1_pd(a[2]); c20 = _mm512_fmadd_pd(ar, b0, c20); c21 = _mm512_fmadd_pd(ar, b1, c21);
+        ar = _mm512_set1_pd(a[3]); c30 = _mm512_fmadd_pd(ar, b0, c30); c31 = _mm512_fmadd_pd(ar, b1, c31);
+        ar = _mm512_set1_pd(a[4]); c40 = _mm512_fmadd_pd(ar, b0, c40); c41 = _mm512_fmadd_pd(ar, b1, c41);
+        ar = _mm512_set1_pd(a[5]); c50 = _mm512_fmadd_pd(ar, b0, c50); c51 = _mm512_fmadd_pd(ar, b1, c51);
+        ar = _mm512_set1_pd(a[6]); c60 = _mm512_fmadd_pd(ar, b0, c60); c61 = _mm512_fmadd_pd(ar, b1, c61);
+        ar = _mm512_set1_pd(a[7]); c70 = _mm512_fmadd_pd(ar, b0, c70); c71 = _mm512_fmadd_pd(ar, b1, c71);
+
+        a += AVX512_MR;
+        b += AVX512_NR;
+    }
+
+    __m512d tile[AVX512_MR][2] = {{c00, c01}, {c10, c11}, {c20, c21}, {c30, c31},
+                                  {c40, c41}, {c50, c51}, {c60, c61}, {c70, c71}};
+    __m512d alpha_v = _mm512_set1_pd(alpha);
+
+    if(rows == AVX512_MR && cols == AVX512_NR){
+        for(unsigned int r = 0; r < AVX512_MR; r++){
+            double* c_row = c + r * ldc;
+            _mm512_storeu_pd(c_row,     _mm512_fmadd_pd(alpha_v, tile[r][0], _mm512_loadu_pd(c_row)));
+            _mm512_storeu_pd(c_row + 8, _mm512_fmadd_pd(alpha_v, tile[r][1], _mm512_loadu_pd(c_row + 8)));
+        }
+        return;
+    }
+
+    alignas(64) double spill[AVX512_MR * AVX512_NR];
+    for(unsigned int r = 0; r < AVX512_MR; r++){
+        _mm512_store_pd(spill + r * AVX512_NR,     tile[r][0]);
+        _mm512_store_pd(spill + r * AVX512_NR + 8, tile[r][1]);
+    }
+    for(unsigned int r = 0; r < rows; r++){
+        for(unsigned int j = 0; j < cols; j++){
+            c[r * ldc + j] += alpha * spill[r * AVX512_NR + j];
+        }
+    }
+}
+
+bool cpu_supports_avx2(){
+#if defined(__GNUC__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool fma = (info[2] & (1 << 12)) != 0;
+    if(!osxsave || !fma || (_xgetbv(0) & 0x6) != 0x6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#endif
+}
+
+bool cpu_supports_avx512(){
+#if defined(__GNUC__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f");
+#else
+    int info[4];
+    __cpuid(info, 1);
+    if((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 0xe6) != 0xe6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 16)) != 0;
+#endif
+}
+
+#endif
+
+KernelInfo kernel_info(GemmKernel kernel){
+    switch(kernel){
+#if IRIS_SIMD_X86
+        case GemmKernel::AVX512: return KernelInfo{AVX512_MR, AVX512_NR, micro_avx512};
+        case GemmKernel::AVX2:   return KernelInfo{AVX2_MR, AVX2_NR, micro_avx2};
+#endif
+        default:                 return KernelInfo{SCALAR_MR, SCALAR_NR, micro_scalar};
+    }
+}
+
+GemmKernel detect_kernel(){
+    if(const char* forced = std::getenv("IRIS_GEMM_KERNEL")){
+        if(std::strcmp(forced, "scalar") == 0) return GemmKernel::Scalar;
+        if(std::strcmp(forced, "avx2") == 0 && gemm_kernel_supported(GemmKernel::AVX2)) return GemmKernel::AVX2;
+        if(std::strcmp(forced, "avx512") == 0 && gemm_kernel_supported(GemmKernel::AVX512)) return GemmKernel::AVX512;
+    }
+    if(gemm_kernel_supported(GemmKernel::AVX512)) return GemmKernel::AVX512;
+    if(gemm_kernel_supported(GemmKernel::AVX2)) return GemmKernel::AVX2;
+    return GemmKernel::Scalar;
+}
+
+std::atomic<int>& kernel_choice(){
+    static std::atomic<int> choice(static_cast<int>(detect_kernel()));
+    return choice;
+}
+
+// Copy op(A)[row0 .. row0 + mc) x [col0 .. col0 + kc) into MR-row panels, each stored k-major and zero padded
+void pack_a(bool transpose, const double* a, unsigned int lda, unsigned int row0, unsigned int col0,
+            unsigned int mc, unsigned int kc, unsigned int mr, double* out){
+    for(unsigned int ir = 0; ir < mc; ir += mr){
+        unsigned int rows = std::min(mr, mc - ir);
+        for(unsigned int p = 0; p < kc; p++){
+            for(unsigned int r = 0; r < mr; r++){
+                double value = 0.0;
+                if(r < rows){
+                    std::size_t i = row0 + ir + r;
+                    std::size_t col = col0 + p;
+                    value = transpose ? a[col * lda + i] : a[i * lda + col];
+                }
+                *out++ = value;
+            }
+        }
+    }
+}
+
+// Copy op(B)[row0 .. row0 + kc) x [col0 .. col0 + nc) into NR-column panels, each stored k-major and zero padded
+void pack_b(bool transpose, const double* b, unsigned int ldb, unsigned int row0, unsigned int col0,
+            unsigned int kc, unsigned int nc, unsigned int nr, double* out){
+    for(unsigned int jr = 0; jr < nc; jr += nr){
+        unsigned int cols = std::min(nr, nc - jr);
+        for(unsigned int p = 0; p < kc; p++){
+            std::size_t row = row0 + p;
+            for(unsigned int j = 0; j < nr; j++){
+                double value = 0.0;
+                if(j < cols){
+                    std::size_t col = col0 + jr + j;
+                    value = transpose ? b[col * ldb + row] : b[row * ldb + col];
+                }
+                *out++ = value;
+            }
+        }
+    }
+}
+
+// Straight triple loop for tiny products where packing would cost more than the multiply
+// The transpose flags are template parameters so the inner loop has no branches
+template <bool TransposeA, bool TransposeB>
+void gemm_small(unsigned int m, unsigned int n, unsigned int k,
+                double alpha, const double* a, unsigned int lda, const double* b, unsigned int ldb,
+                double beta, double* c, unsigned int ldc){
+    for(unsigned int i = 0; i < m; i++){
+        for(unsigned int j = 0; j < n; j++){
+            double sum = 0.0;
+            for(unsigned int p = 0; p < k; p++){
+                double a_val = TransposeA ? a[static_cast<std::size_t>(p) * lda + i] : a[static_cast<std::size_t>(i) * lda + p];
+                double b_val = TransposeB ? b[static_cast<std::size_t>(j) * ldb + p] : b[static_cast<std::size_t>(p) * ldb + j];
+                sum += a_val * b_val;
+            }
+            double* out = c + static_cast<std::size_t>(i) * ldc + j;
+            *out = (beta == 0.0) ? alpha * sum : alpha * sum + beta * *out;
+        }
+    }
+}
+
+}
+
+bool gemm_kernel_supported(GemmKernel kernel){
+    switch(kernel){
+        case GemmKernel::Scalar: return true;
+#if IRIS_SIMD_X86
+        case GemmKernel::AVX2:   return cpu_supports_avx2();
+        case GemmKernel::AVX512: return cpu_supports_avx512();
+#endif
+        default:                 return false;
+    }
+}
+
+const char* gemm_kernel_name(GemmKernel kernel){
+    switch(kernel){
+        case GemmKernel::AVX2:   return "avx2";
+        case GemmKernel::AVX512: return "avx512";
+        default:                 return "scalar";
+    }
+}
+
+GemmKernel active_gemm_kernel(){
+    return static_cast<GemmKernel>(kernel_choice().load(std::memory_order_relaxed));
+}
+
+bool vector_kernels_enabled(){
+#if IRIS_SIMD_X86
+    return active_gemm_kernel() != GemmKernel::Scalar;
+#else
+    return false;
+#endif
+}
+
+bool set_gemm_kernel(GemmKernel kernel){
+    if(!gemm_kernel_supported(kernel)){
+        return false;
+    }
+    kernel_choice().store(static_cast<int>(kernel), std::memory_order_relaxed);
+    return true;
+}
+
+void gemm(bool transpose_a, bool transpose_b,
+          unsigned int m, unsigned int n, unsigned int k,
+          double alpha, const double* a, unsigned int lda,
+          const double* b, unsigned int ldb,
+          double beta, double* c, unsigned int ldc){
+    if(m == 0 || n == 0){
+        return;
+    }
+
+    if(static_cast<std::uint64_t>(m) * n * k <= SMALL_GEMM_WORK){
+        if(transpose_a){
+            if(transpose_b) gemm_small<true, true>(m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+            else            gemm_small<true, false>(m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+        } else {
+            if(transpose_b) gemm_small<false, true>(m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+            else            gemm_small<false, false>(m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+        }
+        return;
+    }
+
+    // Apply beta up front, the blocked loop below then only ever accumulates into C
+    for(unsigned int i = 0; i < m; i++){
+        double* c_row = c + static_cast<std::size_t>(i) * ldc;
+        if(beta == 0.0){
+            std::fill(c_row, c_row + n, 0.0);
+        } else if(beta != 1.0){
+            for(unsigned int j = 0; j < n; j++) c_row[j] *= beta;
+        }
+    }
+    if(alpha == 0.0 || k == 0){
+        return;
+    }
+
+    KernelInfo kernel = kernel_info(active_gemm_kernel());
+
+    // Packing buffers live per thread and only ever grow, so steady-state calls do not allocate
+    thread_local std::vector<double> packed_a;
+    thread_local std::vector<double> packed_b;
+    std::size_t mc_padded = (MC + kernel.mr - 1) / kernel.mr * kernel.mr;
+    std::size_t nc_padded = (NC + kernel.nr - 1) / kernel.nr * kernel.nr;
+    if(packed_a.size() < mc_padded * KC) packed_a.resize(mc_padded * KC);
+    if(packed_b.size() < nc_padded * KC) packed_b.resize(nc_padded * KC);
+
+    for(unsigned int jc = 0; jc < n; jc += NC){
+        unsigned int nc = std::min(NC, n - jc);
+
+        for(unsigned int pc = 0; pc < k; pc += KC){
+            unsigned int kc = std::min(KC, k - pc);
+            pack_b(transpose_b, b, ldb, pc, jc, kc, nc, kernel.nr, packed_b.data());
+
+            for(unsigned int ic = 0; ic < m; ic += MC){
+                unsigned int mc = std::min(MC, m - ic);
+                pack_a(transpose_a, a, lda, ic, pc, mc, kc, kernel.mr, packed_a.data());
+
+                for(unsigned int jr = 0; jr < nc; jr += kernel.nr){
+                    const double* b_panel = packed_b.data() + static_cast<std::size_t>(jr) * kc;
+                    unsigned int cols = std::min(kernel.nr, nc - jr);
+
+                    for(unsigned int ir = 0; ir < mc; ir += kernel.mr){
+                        const double* a_panel = packed_a.data() + static_cast<std::size_t>(ir) * kc;
+                        unsigned int rows = std::min(kernel.mr, mc - ir);
+                        double* c_tile = c + static_cast<std::size_t>(ic + ir) * ldc + jc + jr;
+                        kernel.micro(kc, a_panel, b_panel, c_tile, ldc, alpha, rows, cols);
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,280 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+#include "layers.hpp"
+#include "gemm.hpp"
+
+// Every tensor in a parameter buffer and every block in an arena starts on a 64-byte cache line
+static constexpr std::size_t BLOCK_DOUBLES = Matrix::ALIGNMENT / sizeof(double);
+
+static std::size_t align_block(std::size_t count){
+    return (count + BLOCK_DOUBLES - 1) / BLOCK_DOUBLES * BLOCK_DOUBLES;
+}
+
+NetworkSpec::NetworkSpec(unsigned int inputs)
+    : inputs(inputs), loss_function(Loss::MeanSquaredError) {
+}
+
+NetworkSpec& NetworkSpec::dense(unsigned int units){
+    layer_specs.push_back(DenseLayerSpec{units, Activation::Identity});
+    return *this;
+}
+
+NetworkSpec& NetworkSpec::activation(Activation activation){
+    if(layer_specs.empty()){
+        throw std::logic_error("An activation needs a dense layer before it");
+    }
+    if(layer_specs.back().activation != Activation::Identity){
+        throw std::logic_error("The last dense layer already has an activation");
+    }
+
+    layer_specs.back().activation = activation;
+    return *this;
+}
+
+NetworkSpec& NetworkSpec::loss(Loss loss){
+    loss_function = loss;
+    return *this;
+}
+
+NetworkSpec NetworkSpec::two_layer(unsigned int inputs, unsigned int hidden, unsigned int outputs){
+    return NetworkSpec(inputs).dense(hidden).activation(Activation::Sigmoid)
+                              .dense(outputs).activation(Activation::Sigmoid)
+                              .loss(Loss::MeanSquaredError);
+}
+
+NetworkSpec NetworkSpec::softmax_classifier(unsigned int inputs, unsigned int hidden, unsigned int outputs){
+    return NetworkSpec(inputs).dense(hidden).activation(Activation::Sigmoid)
+                              .dense(outputs).activation(Activation::Softmax)
+                              .loss(Loss::CrossEntropy);
+}
+
+LayerStack::LayerStack(const NetworkSpec& spec)
+    : spec(spec), total_parameters(0), widest_layer(0) {
+    if(spec.input_size() == 0 || spec.layers().empty()){
+        throw std::invalid_argument("A network needs inputs and at least one layer");
+    }
+
+    // Weights then bias for each layer in order, every tensor aligned to a cache line
+    for(unsigned int layer = 0; layer < num_layers(); layer++){
+        unsigned int units = spec.layers()[layer].units;
+        if(units == 0){
+            throw std::invalid_argument("Every layer needs at least one unit");
+        }
+
+        weight_offsets.push_back(total_parameters);
+        total_parameters += align_block(std::size_t(layer_inputs(layer)) * units);
+        bias_offsets.push_back(total_parameters);
+        total_parameters += align_block(units);
+
+        widest_layer = std::max(widest_layer, units);
+    }
+
+    // The softmax derivative only exists fused with cross-entropy, where the output error is simply a - y
+    bool softmax_output = spec.layers().back().activation == Activation::Softmax;
+    if(softmax_output != (spec.get_loss() == Loss::CrossEntropy)){
+        throw std::invalid_argument("Cross-entropy needs a softmax output layer and softmax needs cross-entropy");
+    }
+    for(unsigned int layer = 0; layer + 1 < num_layers(); layer++){
+        if(spec.layers()[layer].activation == Activation::Softmax){
+            throw std::invalid_argument("Softmax can only be the activation of the output layer");
+        }
+    }
+}
+
+MatrixView LayerStack::weights(const double* parameters, unsigned int layer) const {
+    return MatrixView(parameters + weight_offsets[layer], layer_inputs(layer), spec.layers()[layer].units);
+}
+
+MatrixView LayerStack::bias(const double* parameters, unsigned int layer) const {
+    return MatrixView(parameters + bias_offsets[layer], 1, spec.layers()[layer].units);
+}
+
+void LayerStack::prepare(InferenceWorkspace& ws, unsigned int rows) const {
+    bool same_layers = ws.widths.size() == num_layers();
+    for(unsigned int layer = 0; same_layers && layer < num_layers(); layer++){
+        same_layers = ws.widths[layer] == spec.layers()[layer].units;
+    }
+    if(same_layers && ws.rows == rows){
+        return;
+    }
+
+    // The vectors keep their capacity, so switching between batch sizes of the same stack never allocates
+    ws.rows = rows;
+    ws.widths.resize(num_layers());
+    ws.z_offsets.resize(num_layers());
+    ws.a_offsets.resize(num_layers());
+
+    std::size_t offset = 0;
+    for(unsigned int layer = 0; layer < num_layers(); layer++){
+        const DenseLayerSpec& layer_spec = spec.layers()[layer];
+        std::size_t block = align_block(std::size_t(rows) * layer_spec.units);
+
+        ws.widths[layer] = layer_spec.units;
+        ws.z_offsets[layer] = offset;
+        offset += block;
+
+        // Without an activation the output is the pre-activation itself
+        if(layer_spec.activation == Activation::Identity){
+            ws.a_offsets[layer] = ws.z_offsets[layer];
+        } else {
+            ws.a_offsets[layer] = offset;
+            offset += block;
+        }
+    }
+
+    // Back propagation alternates between two error blocks as wide as the widest layer
+    if(ws.with_errors){
+        std::size_t block = align_block(std::size_t(rows) * widest_layer);
+        ws.error_offsets[0] = offset;
+        ws.error_offsets[1] = offset + block;
+        offset += 2 * block;
+    }
+
+    if(offset > ws.arena.size()){
+        ws.arena.resize(1, static_cast<unsigned int>(offset));
+    }
+}
+
+void LayerStack::forward(const MatrixView& input, const double* parameters, InferenceWorkspace& ws) const {
+    if(input.get_num_col() != input_size()){
+        throw std::invalid_argument("Input width does not match the network");
+    }
+
+    unsigned int rows = input.get_num_rows();
+    prepare(ws, rows);
+
+    const double* layer_input = input.data();
+    for(unsigned int layer = 0; layer < num_layers(); layer++){
+        const DenseLayerSpec& layer_spec = spec.layers()[layer];
+        unsigned int inputs = layer_inputs(layer);
+        unsigned int units = layer_spec.units;
+
+        double* z = ws.arena.data() + ws.z_offsets[layer];
+        double* a = ws.arena.data() + ws.a_offsets[layer];
+        const double* b = parameters + bias_offsets[layer];
+
+        // input * W through the blocked GEMM, the bias row is added to every sample
+        gemm(false, false, rows, units, inputs, 1.0, layer_input, inputs, parameters + weight_offsets[layer], units, 0.0, z, units);
+
+        for(unsigned int i = 0; i < rows; i++){
+            double* z_row = z + std::size_t(i) * units;
+            for(unsigned int j = 0; j < units; j++){
+                z_row[j] += b[j];
+            }
+        }
+
+        // The whole batch goes through the activation kernel at once, which keeps its loop long enough to vectorize
+        apply_activation(layer_spec.activation, z, a, std::size_t(rows) * units, units);
+
+        layer_input = a;
+    }
+}
+
+void LayerStack::backward(const MatrixView& input, const MatrixView& expected_output, const double* parameters, TrainingWorkspace& ws, double scale) const {
+    unsigned int rows = input.get_num_rows();
+    if(!ws.with_errors || ws.rows != rows || ws.widths.size() != num_layers()){
+        throw std::logic_error("Back propagation needs a forward pass of the same batch in a training workspace");
+    }
+    if(expected_output.get_num_rows() != rows || expected_output.get_num_col() != output_size()){
+        throw std::invalid_argument("Expected output does not match the network output");
+    }
+
+    // Zero-filled once so the padding between tensors stays zero
+    if(ws.gradients.size() != total_parameters){
+        ws.gradients = Matrix(1, static_cast<unsigned int>(total_parameters));
+    }
+    double* gradients = ws.gradients.data();
+
+    double* error = ws.arena.data() + ws.error_offsets[0];
+    double* next_error = ws.arena.data() + ws.error_offsets[1];
+
+    // Error at the output, a - y, taken from the activations the forward pass already computed
+    // For softmax with cross-entropy this is the exact gradient with respect to the pre-activations
+    const double* output = ws.arena.data() + ws.a_offsets[num_layers() - 1];
+    for(unsigned int i = 0; i < rows; i++){
+        const double* expected_row = expected_output.row(i);
+        for(unsigned int j = 0; j < output_size(); j++){
+            std::size_t index = std::size_t(i) * output_size() + j;
+            error[index] = output[index] - expected_row[j];
+        }
+    }
+
+    for(unsigned int layer = num_layers(); layer-- > 0;){
+        unsigned int inputs = layer_inputs(layer);
+        unsigned int units = spec.layers()[layer].units;
+        const double* layer_input = layer == 0 ? input.data() : ws.arena.data() + ws.a_offsets[layer - 1];
+
+        // dW = scale * input^T * error
+        gemm(true, false, inputs, units, rows, scale, layer_input, inputs, error, units, 0.0, gradients + weight_offsets[layer], units);
+
+        // db = scale * column sums of the error, row by row so the error is streamed once in memory order
+        double* db = gradients + bias_offsets[layer];
+        std::fill(db, db + units, 0.0);
+        for(unsigned int i = 0; i < rows; i++){
+            const double* error_row = error + std::size_t(i) * units;
+            for(unsigned int j = 0; j < units; j++){
+                db[j] += error_row[j];
+            }
+        }
+        for(unsigned int j = 0; j < units; j++){
+            db[j] *= scale;
+        }
+
+        if(layer == 0){
+            break;
+        }
+
+        // Error of the layer below, error * W^T times the slope of that layer's activation
+        gemm(false, true, rows, inputs, units, 1.0, error, units, parameters + weight_offsets[layer], units, 0.0, next_error, inputs);
+
+        multiply_activation_slope(spec.layers()[layer - 1].activation, ws.arena.data() + ws.a_offsets[layer - 1],
+                                  ws.arena.data() + ws.z_offsets[layer - 1], next_error, std::size_t(rows) * inputs);
+
+        std::swap(error, next_error);
+    }
+}
+
+double LayerStack::loss(const InferenceWorkspace& ws, const MatrixView& expected_output) const {
+    if(spec.get_loss() == Loss::CrossEntropy){
+        return softmax_cross_entropy(ws.pre_activations(num_layers() - 1), expected_output);
+    }
+    return mean_squared_error(ws.output(), expected_output);
+}
+
+// The loss/cost function that compares the output to the expected
+// In summary, this tells you how bad the network is performance wise
+// For a batch this is the summed error of all of its samples
+double mean_squared_error(const MatrixView& prediction, const MatrixView& actual){
+    double error = 0.0;
+    for(unsigned int i = 0; i < prediction.get_num_rows(); i++){
+        for(unsigned int j = 0; j < prediction.get_num_col(); j++){
+            error += std::pow(prediction.get_val(i, j) - actual.get_val(i, j), 2);
+        }
+    }
+    return error / 2.0;
+}
+
+// -sum(y * log(softmax(z))) over every sample, with log(softmax(z)_j) = z_j - log(sum(exp(z))) and the row maximum
+// subtracted first so nothing overflows
+double softmax_cross_entropy(const MatrixView& logits, const MatrixView& actual){
+    double error = 0.0;
+    for(unsigned int i = 0; i < logits.get_num_rows(); i++){
+        const double* z = logits.row(i);
+        const double* y = actual.row(i);
+        unsigned int cols = logits.get_num_col();
+
+        double largest = *std::max_element(z, z + cols);
+        double sum = 0.0;
+        for(unsigned int j = 0; j < cols; j++){
+            sum += std::exp(z[j] - largest);
+        }
+        double log_sum = largest + std::log(sum);
+
+        for(unsigned int j = 0; j < cols; j++){
+            error += y[j] * (log_sum - z[j]);
+        }
+    }
+    return error;
+}
@@ -0,0 +1,147 @@
+// Memory-mapped read-only files on POSIX and Windows
+
+#include "mappedFile.hpp"
+#include <stdexcept>
+#include <utility>
+
+#if defined(_WIN32)
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+MappedFile::MappedFile(const std::string& path)
+    : view(nullptr), length(0), file_handle(INVALID_HANDLE_VALUE), mapping_handle(nullptr) {
+
+    file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if(file_handle == INVALID_HANDLE_VALUE){
+        throw std::runtime_error("Could not open " + path);
+    }
+
+    LARGE_INTEGER file_size;
+    if(!GetFileSizeEx(file_handle, &file_size)){
+        release();
+        throw std::runtime_error("Could not read the size of " + path);
+    }
+    length = static_cast<std::size_t>(file_size.QuadPart);
+    if(length == 0){
+        return;
+    }
+
+    mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(mapping_handle == nullptr){
+        release();
+        throw std::runtime_error("Could not map " + path);
+    }
+
+    view = static_cast<const char*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+    if(view == nullptr){
+        release();
+        throw std::runtime_error("Could not map " + path);
+    }
+}
+
+void MappedFile::release(){
+    if(view) UnmapViewOfFile(view);
+    if(mapping_handle) CloseHandle(mapping_handle);
+    if(file_handle != INVALID_HANDLE_VALUE) CloseHandle(file_handle);
+    view = nullptr;
+    length = 0;
+    mapping_handle = nullptr;
+    file_handle = INVALID_HANDLE_VALUE;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : view(other.view), length(other.length), file_handle(other.file_handle), mapping_handle(other.mapping_handle) {
+    other.view = nullptr;
+    other.length = 0;
+    other.file_handle = INVALID_HANDLE_VALUE;
+    other.mapping_handle = nullptr;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if(this != &other){
+        release();
+        std::swap(view, other.view);
+        std::swap(length, other.length);
+        std::swap(file_handle, other.file_handle);
+        std::swap(mapping_handle, other.mapping_handle);
+    }
+    return *this;
+}
+
+// Windows already reads ahead for FILE_FLAG_SEQUENTIAL_SCAN handles
+void MappedFile::advise_sequential() const {
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path)
+    : view(nullptr), length(0) {
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0){
+        throw std::runtime_error("Could not open " + path);
+    }
+
+    struct stat info;
+    if(::fstat(fd, &info) != 0){
+        ::close(fd);
+        throw std::runtime_error("Could not read the size of " + path);
+    }
+
+    length = static_cast<std::size_t>(info.st_size);
+    if(length > 0){
+        void* mapped = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(mapped == MAP_FAILED){
+            ::close(fd);
+            throw std::runtime_error("Could not map " + path);
+        }
+        view = static_cast<const char*>(mapped);
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    ::close(fd);
+}
+
+void MappedFile::release(){
+    if(view){
+        ::munmap(const_cast<char*>(view), length);
+    }
+    view = nullptr;
+    length = 0;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : view(other.view), length(other.length) {
+    other.view = nullptr;
+    other.length = 0;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if(this != &other){
+        release();
+        std::swap(view, other.view);
+        std::swap(length, other.length);
+    }
+    return *this;
+}
+
+void MappedFile::advise_sequential() const {
+    if(view){
+        ::madvise(const_cast<char*>(view), length, MADV_SEQUENTIAL);
+    }
+}
+
+#endif
+
+MappedFile::~MappedFile(){
+    release();
+}
@@ -1,21 +1,98 @@
 // Matrix class implementation used for basic matrix operations within neural networks
 
 #include "matrix.hpp"
+#include <algorithm>
+#include <functional>
+#include "gemm.hpp"
+#include "profiler.hpp"
 
 
 Matrix::Matrix(unsigned int rows, unsigned int col)
-    : num_rows(rows), num_col(col), engine(42), dist(0.0, 0.1) {
-    
-    arr2D = std::vector<std::vector<double>>(num_rows, std::vector<double>(num_col));
-    randomize_matrix();
+    : num_rows(0), num_col(0), capacity(0) {
+    IRIS_PROFILE_COUNT(ProfileCounter::MatrixConstructions, 1);
+
+    resize(rows, col);
+    std::fill(data(), data() + size(), 0.0);
+}
+
+Matrix::Matrix()
+    : num_rows(0), num_col(0), capacity(0) {
+    IRIS_PROFILE_COUNT(ProfileCounter::MatrixConstructions, 1);
+}
+
+Matrix::Matrix(unsigned int rows, unsigned int col, double fill_value)
+    : num_rows(0), num_col(0), capacity(0) {
+    IRIS_PROFILE_COUNT(ProfileCounter::MatrixConstructions, 1);
+
+    resize(rows, col);
+    std::fill(data(), data() + size(), fill_value);
+}
+
+Matrix::Matrix(const Matrix& other)
+    : num_rows(0), num_col(0), capacity(0) {
+    IRIS_PROFILE_COUNT(ProfileCounter::MatrixConstructions, 1);
+
+    resize(other.num_rows, other.num_col);
+    std::copy(other.data(), other.data() + other.size(), data());
+}
+
+Matrix::Matrix(Matrix&& other) noexcept
+    : num_rows(other.num_rows), num_col(other.num_col), capacity(other.capacity), buffer(std::move(other.buffer)) {
+    IRIS_PROFILE_COUNT(ProfileCounter::MatrixConstructions, 1);
+
+    other.num_rows = 0;
+    other.num_col = 0;
+    other.capacity = 0;
+}
+
+Matrix Matrix::uninitialized(unsigned int rows, unsigned int col){
+    Matrix result;
+    result.resize(rows, col);
+    return result;
+}
+
+Matrix Matrix::random(unsigned int rows, unsigned int col, std::mt19937& engine, double low, double high){
+    Matrix result = uninitialized(rows, col);
+    randomize_matrix(result, engine, low, high);
+    return result;
 }
 
-Matrix::Matrix(){
-    num_rows = 0;
-    num_col = 0;
-    engine = std::mt19937(42);
-    dist = std::uniform_real_distribution<double>(0.0, 0.1);
-    arr2D = std::vector<std::vector<double>>(num_rows, std::vector<double>(num_col));
+// Copy assignment keeps the existing buffer when it is large enough, so reassigning same-shaped matrices never allocates
+Matrix& Matrix::operator=(const Matrix& other){
+    if(this != &other){
+        resize(other.num_rows, other.num_col);
+        std::copy(other.data(), other.data() + other.size(), data());
+    }
+    return *this;
+}
+
+Matrix& Matrix::operator=(Matrix&& other) noexcept {
+    if(this != &other){
+        num_rows = other.num_rows;
+        num_col = other.num_col;
+        capacity = other.capacity;
+        buffer = std::move(other.buffer);
+
+        other.num_rows = 0;
+        other.num_col = 0;
+        other.capacity = 0;
+    }
+    return *this;
+}
+
+// Resize the matrix to rows x col, the contents are left unspecified
+void Matrix::resize(unsigned int rows, unsigned int col){
+    std::size_t needed = static_cast<std::size_t>(rows) * col;
+
+    if(needed > capacity){
+        IRIS_PROFILE_COUNT(ProfileCounter::MatrixAllocations, 1);
+        IRIS_PROFILE_COUNT(ProfileCounter::BytesAllocated, needed * sizeof(double));
+        buffer.reset(static_cast<double*>(::operator new(needed * sizeof(double), std::align_val_t(ALIGNMENT))));
+        capacity = needed;
+    }
+
+    num_rows = rows;
+    num_col = col;
 }
 
 // Function to get the number of rows
@@ -30,155 +107,169 @@ unsigned int Matrix::get_num_col() const {
 
 // Function to get the value at a specific position
 double Matrix::get_val(unsigned int row, unsigned int col) const {
-    return arr2D[row][col];
+    return buffer[static_cast<std::size_t>(row) * num_col + col];
 }
 
 // Given a row and col, set that position to the provided value
 void Matrix::set_val(unsigned int row, unsigned int col, double value){
-    arr2D[row][col] = value; 
+    buffer[static_cast<std::size_t>(row) * num_col + col] = value;
 }
 
 
 // Matrix multiplication through operator overloading
 Matrix Matrix::operator*(const Matrix& other) const {
-    if(num_col != other.num_rows){
-        throw std::invalid_argument("Matrix dimensions do not match for multiplication");
-    }
-
-    // Initialize the result matrix with proper dimensions
-    Matrix result(num_rows, other.num_col);
-
-    for(unsigned int i = 0; i < num_rows; i++){
-        for(unsigned int j = 0; j < other.num_col; j++){
-            result.arr2D[i][j] = 0.0;
-            for(unsigned int k = 0; k < num_col; k++){
-                result.arr2D[i][j] += arr2D[i][k] * other.arr2D[k][j];
-            }
-        }
-    }
+    Matrix result;
+    gemm_into(*this, other, result);
     return result;
 }
 
 // Transpose the matrix by swapping rows and columns and return the transposed matrix
 Matrix Matrix::transpose() const {
-Matrix newMatrix(num_col, num_rows); 
+    Matrix newMatrix;
+    transpose_into(newMatrix);
+    return newMatrix;
+}
 
-for (unsigned int i = 0; i < num_rows; i++) {
-    for (unsigned int j = 0; j < num_col; j++) {
-        newMatrix.set_val(j, i, arr2D[i][j]); 
+void Matrix::transpose_into(Matrix& out) const {
+    if(&out == this){
+        throw std::invalid_argument("Matrix cannot be transposed into itself");
     }
-}
 
-return newMatrix;
+    out.resize(num_col, num_rows);
+
+    for (unsigned int i = 0; i < num_rows; i++) {
+        for (unsigned int j = 0; j < num_col; j++) {
+            out.set_val(j, i, buffer[static_cast<std::size_t>(i) * num_col + j]);
+        }
+    }
 }
 
-// Returns the result of adding up two matrices
-Matrix Matrix::operator+(const Matrix& other) const
-{
-// Matrix addition only applies if the dimensions of the two matrices are the same, if not throw an error
-if(num_rows != other.num_rows || num_col != other.num_col){
-    throw std::invalid_argument("Matrix dimensions do not match for addition");
+Matrix& Matrix::operator*=(double scalar){
+    for(std::size_t i{}; i < size(); i++){
+        buffer[i] *= scalar;
+    }
+    return *this;
 }
 
-// Initialize the result matrix with proper dimensions
-Matrix result(num_rows, num_col);
+void Matrix::sub_scaled(const Matrix& other, double scale){
+    if(num_rows != other.num_rows || num_col != other.num_col){
+        throw std::invalid_argument("Matrix dimensions do not match for subtraction");
+    }
 
-// Main loop where each of the elements from each matrix are added together and stored in the result matrix
-for(unsigned int i{}; i < num_rows; i++){
-    for(unsigned int j{}; j < num_col; j++){
-        result.arr2D[i][j] = arr2D[i][j] + other.arr2D[i][j];
+    for(std::size_t i{}; i < size(); i++){
+        buffer[i] -= other.buffer[i] * scale;
     }
 }
 
-return result;
+namespace {
+
+// True if [a, a + a_size) and [b, b + b_size) share an element, std::less orders pointers into unrelated buffers too
+bool overlaps(const double* a, std::size_t a_size, const double* b, std::size_t b_size){
+    std::less<const double*> before;
+    return a_size != 0 && b_size != 0 && before(a, b + b_size) && before(b, a + a_size);
 }
 
-Matrix Matrix::operator-(const Matrix& other) const
-{
-// Matrix subtraction only applies if the dimensions of the two matrices are the same, if not throw an error
-if(num_rows != other.num_rows || num_col != other.num_col){
-    throw std::invalid_argument("Matrix dimensions do not match for subtraction");
 }
 
-// Initialize the result matrix with proper dimensions
-Matrix result(num_rows, num_col);
+void gemm_into(const GemmOperand& a, const GemmOperand& b, Matrix& out, double alpha, double beta){
+    unsigned int rows = a.transposed ? a.matrix.get_num_col() : a.matrix.get_num_rows();
+    unsigned int inner = a.transposed ? a.matrix.get_num_rows() : a.matrix.get_num_col();
+    unsigned int b_rows = b.transposed ? b.matrix.get_num_col() : b.matrix.get_num_rows();
+    unsigned int cols = b.transposed ? b.matrix.get_num_rows() : b.matrix.get_num_col();
 
-// Main loop where each of the elements from each matrix are subtracted and stored in the result matrix
-for(unsigned int i{}; i < num_rows; i++){
-    for(unsigned int j{}; j < num_col; j++){
-        result.arr2D[i][j] = arr2D[i][j] - other.arr2D[i][j];
+    if(inner != b_rows){
+        throw std::invalid_argument("Matrix dimensions do not match for multiplication");
+    }
+    // Any overlap counts, a view of some rows of out would be read after the kernel already overwrote them
+    if(overlaps(out.data(), out.size(), a.matrix.data(), a.matrix.size()) ||
+       overlaps(out.data(), out.size(), b.matrix.data(), b.matrix.size())){
+        throw std::invalid_argument("Matrix product cannot be written into memory one of its operands uses");
     }
-}
 
-return result;
-}
+    if(beta == 0.0){
+        out.resize(rows, cols);
+    } else if(out.get_num_rows() != rows || out.get_num_col() != cols){
+        throw std::invalid_argument("Matrix dimensions do not match for accumulation");
+    }
 
-// Each entry (i, j) of matrix one is multipied by the equivalent entry in matrix 
-Matrix Matrix::elementwise_multiply(const Matrix& other) const
-{
-if(num_rows != other.num_rows || num_col != other.num_col){
-    throw std::invalid_argument("Matrix dimesions do not match for multiplication");
+    gemm(a.transposed, b.transposed, rows, cols, inner,
+         alpha, a.matrix.data(), a.matrix.get_stride(),
+         b.matrix.data(), b.matrix.get_stride(),
+         beta, out.data(), out.get_stride());
 }
 
-Matrix result(num_rows, num_col);
-
-for(unsigned int i{}; i < num_rows; i++){
-    for (unsigned int j{}; j < num_col; j++){
-        result.arr2D[i][j] = arr2D[i][j] * other.arr2D[i][j];
+void column_sums_into(const Matrix& m, Matrix& out, double scale){
+    if(&out == &m){
+        throw std::invalid_argument("Column sums cannot be written into their own input");
     }
-}
 
-return result;
-}
+    unsigned int cols = m.get_num_col();
+    out.resize(1, cols);
+    double* sums = out.data();
+    std::fill(sums, sums + cols, 0.0);
 
-// Multiply each entry in the matrix by the same scalar value
-Matrix Matrix::operator*(double scalar) const
-{
-Matrix result(num_rows, num_col);
+    // Row by row so the whole matrix is streamed once in memory order
+    for(unsigned int i = 0; i < m.get_num_rows(); i++){
+        const double* m_row = m.row(i);
+        for(unsigned int j = 0; j < cols; j++){
+            sums[j] += m_row[j];
+        }
+    }
 
-for(unsigned int i{}; i < num_rows; i++){
-    for(unsigned int j{}; j < num_col; j++){
-        result.arr2D[i][j] = arr2D[i][j] * scalar;
+    for(unsigned int j = 0; j < cols; j++){
+        sums[j] *= scale;
     }
 }
 
-return result;
+Matrix operator*(const GemmOperand& a, const GemmOperand& b){
+    Matrix result;
+    gemm_into(a, b, result);
+    return result;
 }
 
-// Apply a function to each entry in the matrix and return the resulting matrix
-Matrix Matrix::apply_function(double (*func)(double)) const{
-
-// Initialize the result matrix with proper dimensions
-Matrix result(num_rows, num_col);
-
-// Main loop where each of the elements from the matrix have the function applied to them and stored in the result matrix   
-for(unsigned int i{}; i < num_rows; i++){
-    for(unsigned int j{}; j < num_col; j++){
-        result.arr2D[i][j] = func(arr2D[i][j]);
-    }
+Matrix linear_activation(const MatrixView& input, const MatrixView& weights, const MatrixView& bias, double (*func)(double), Matrix* pre_activation){
+    Matrix result;
+    linear_activation_into(input, weights, bias, func, result, pre_activation);
+    return result;
 }
 
-return result;
-}
+// Fused dense layer, the product goes through the blocked GEMM and bias + activation are applied in one epilogue pass
+void linear_activation_into(const MatrixView& input, const MatrixView& weights, const MatrixView& bias, double (*func)(double), Matrix& out, Matrix* pre_activation){
+    if((bias.get_num_rows() != 1 && bias.get_num_rows() != input.get_num_rows()) || bias.get_num_col() != weights.get_num_col()){
+        throw std::invalid_argument("Matrix dimensions do not match for addition");
+    }
+    bool broadcast_bias = bias.get_num_rows() == 1;
 
-// Geenerates a random number between 0 and 0.1, this is what fills the matrix at the beginning
-double Matrix::gen_rand(){
-    return dist(engine);
-}   
+    gemm_into(input, weights, out);
 
+    unsigned int rows = out.get_num_rows();
+    unsigned int cols = out.get_num_col();
+    if(pre_activation){
+        pre_activation->resize(rows, cols);
+    }
 
-// Take the matrix and fill it with default values before the training starts
-void Matrix::randomize_matrix(){
-    // outer loop iterate through col first
-    for(unsigned int i{}; i < num_rows; i++){
+    for(unsigned int i = 0; i < rows; i++){
+        const double* bias_row = bias.row(broadcast_bias ? 0 : i);
+        double* out_row = out.row(i);
+        double* pre_row = pre_activation ? pre_activation->row(i) : nullptr;
 
-        // Iterate over each row and fill with random nums
-        for(unsigned int j{}; j < num_col; j++){
-            arr2D[i][j] = gen_rand();
+        for(unsigned int j = 0; j < cols; j++){
+            double sum = out_row[j] + bias_row[j];
+            if(pre_row){
+                pre_row[j] = sum;
+            }
+            out_row[j] = func(sum);
         }
     }
 }
 
+// Take the matrix and fill it with default values before the training starts
+void randomize_matrix(Matrix& matrix, std::mt19937& engine, double low, double high){
+    std::uniform_real_distribution<double> dist(low, high);
 
-
-
+    // The buffer is row-major and contiguous, so this visits the entries in the same order as a row by row loop
+    double* values = matrix.data();
+    for(std::size_t i{}; i < matrix.size(); i++){
+        values[i] = dist(engine);
+    }
+}
@@ -0,0 +1,207 @@
+// Binary model files that are memory-mapped and used for inference in place
+
+#include "modelFile.hpp"
+#include "binaryFile.hpp"
+#include "profiler.hpp"
+#include <stdexcept>
+
+static constexpr char MODEL_FILE_MAGIC[8] = {'I', 'R', 'I', 'S', 'N', 'N', 'E', 'T'};
+
+// Fixed-size header at the start of the file, all offsets are in bytes from the start of the file
+struct ModelFileHeader {
+    BinaryFilePrologue prologue;
+
+    std::uint32_t input_size;
+    std::uint32_t num_layers;
+    std::uint32_t loss;
+
+    // Either 0 or input_size
+    std::uint32_t num_scaled_features;
+
+    std::uint64_t epochs_completed;
+
+    // OptimizerKind, its beta1, beta2 and epsilon and the number of updates it made
+    std::uint32_t optimizer_kind;
+    std::uint32_t reserved;
+    double optimizer_settings[3];
+    std::uint64_t optimizer_steps;
+
+    // num_layers entries of ModelFileLayer
+    std::uint64_t layers_offset;
+
+    // num_scaled_features (offset, scale) pairs of doubles
+    std::uint64_t scaling_offset;
+
+    // parameter_count doubles in the layout LayerStack gives the layer table
+    std::uint64_t parameters_offset;
+    std::uint64_t parameter_count;
+
+    // optimizer_count doubles of optimizer state, either 0 or its state slots times parameter_count
+    std::uint64_t optimizer_offset;
+    std::uint64_t optimizer_count;
+};
+
+struct ModelFileLayer {
+    std::uint32_t units;
+    std::uint32_t activation;
+};
+
+void writeModelFile(const std::string& path, const LayerStack& layers, const double* parameters,
+                    const std::vector<FeatureScaling>& scaling, std::uint64_t epochs_completed, const Optimizer& optimizer){
+    if(!scaling.empty() && scaling.size() != layers.input_size()){
+        throw std::invalid_argument("Feature scaling does not match the number of inputs");
+    }
+    const Matrix& state = optimizer.get_state();
+    if(state.size() != 0 && state.size() != optimizer.state_slots() * layers.parameter_count()){
+        throw std::invalid_argument("Optimizer state does not match the parameters");
+    }
+
+    std::vector<ModelFileLayer> table;
+    for(const DenseLayerSpec& layer : layers.get_spec().layers()){
+        table.push_back(ModelFileLayer{layer.units, static_cast<std::uint32_t>(layer.activation)});
+    }
+
+    ModelFileHeader header{};
+    header.prologue = makeFilePrologue(MODEL_FILE_MAGIC, MODEL_FILE_VERSION);
+    header.input_size = layers.input_size();
+    header.num_layers = layers.num_layers();
+    header.loss = static_cast<std::uint32_t>(layers.get_spec().get_loss());
+    header.num_scaled_features = static_cast<std::uint32_t>(scaling.size());
+    header.epochs_completed = epochs_completed;
+    header.parameter_count = layers.parameter_count();
+
+    const OptimizerSpec& settings = optimizer.get_spec();
+    header.optimizer_kind = static_cast<std::uint32_t>(settings.kind);
+    header.optimizer_settings[0] = settings.beta1;
+    header.optimizer_settings[1] = settings.beta2;
+    header.optimizer_settings[2] = settings.epsilon;
+    header.optimizer_steps = optimizer.get_steps();
+    header.optimizer_count = state.size();
+
+    header.layers_offset = alignSection(sizeof(ModelFileHeader));
+    header.scaling_offset = alignSection(header.layers_offset + table.size() * sizeof(ModelFileLayer));
+    header.parameters_offset = alignSection(header.scaling_offset + scaling.size() * sizeof(FeatureScaling));
+    header.optimizer_offset = alignSection(header.parameters_offset + header.parameter_count * sizeof(double));
+    header.prologue.file_size = header.optimizer_offset + header.optimizer_count * sizeof(double);
+
+    SectionWriter out(path);
+    out.append(&header, sizeof(header));
+    out.write_block(header.layers_offset, table.data(), table.size() * sizeof(ModelFileLayer));
+    out.write_block(header.scaling_offset, scaling.data(), scaling.size() * sizeof(FeatureScaling));
+    out.write_block(header.parameters_offset, parameters, header.parameter_count * sizeof(double));
+    out.write_block(header.optimizer_offset, state.data(), header.optimizer_count * sizeof(double));
+    out.commit();
+}
+
+// The prologue check and the checks of this format's own header, before anything inside the file is trusted
+static const ModelFileHeader& checked_header(const MappedFile& file, const std::string& path){
+    checkFilePrologue(file, path, MODEL_FILE_MAGIC, MODEL_FILE_VERSION, sizeof(ModelFileHeader), "model");
+    const ModelFileHeader& header = *reinterpret_cast<const ModelFileHeader*>(file.data());
+    std::uint64_t file_size = header.prologue.file_size;
+
+    // Bounding the counts by the file size keeps the block sizes below from overflowing
+    if(header.num_layers > file_size / sizeof(ModelFileLayer) || header.parameter_count > file_size / sizeof(double)
+       || header.optimizer_count > file_size / sizeof(double)
+       || (header.num_scaled_features != 0 && header.num_scaled_features != header.input_size)
+       || header.loss > static_cast<std::uint32_t>(Loss::CrossEntropy)
+       || header.optimizer_kind > static_cast<std::uint32_t>(OptimizerKind::Adam)){
+        throw std::runtime_error(path + " has a corrupt header");
+    }
+
+    // Sections have to be aligned, inside the file and in order
+    std::uint64_t layers_bytes = std::uint64_t(header.num_layers) * sizeof(ModelFileLayer);
+    std::uint64_t scaling_bytes = std::uint64_t(header.num_scaled_features) * sizeof(FeatureScaling);
+    std::uint64_t parameters_bytes = header.parameter_count * sizeof(double);
+    std::uint64_t optimizer_bytes = header.optimizer_count * sizeof(double);
+    bool aligned = header.parameters_offset % SECTION_ALIGNMENT == 0 && header.layers_offset % alignof(ModelFileLayer) == 0
+                && header.scaling_offset % alignof(double) == 0 && header.optimizer_offset % alignof(double) == 0;
+    bool inside = sectionInFile(header.layers_offset, layers_bytes, file_size)
+               && sectionInFile(header.scaling_offset, scaling_bytes, file_size)
+               && sectionInFile(header.parameters_offset, parameters_bytes, file_size)
+               && sectionInFile(header.optimizer_offset, optimizer_bytes, file_size);
+    bool ordered = inside && header.layers_offset >= sizeof(ModelFileHeader)
+                && header.scaling_offset >= header.layers_offset + layers_bytes
+                && header.parameters_offset >= header.scaling_offset + scaling_bytes
+                && header.optimizer_offset >= header.parameters_offset + parameters_bytes;
+    if(!aligned || !ordered){
+        throw std::runtime_error(path + " has a corrupt section table");
+    }
+
+    return header;
+}
+
+// Rebuild the network description from the layer table of a checked file
+static NetworkSpec stored_spec(const MappedFile& file, const std::string& path){
+    const ModelFileHeader& header = checked_header(file, path);
+    const ModelFileLayer* table = reinterpret_cast<const ModelFileLayer*>(file.data() + header.layers_offset);
+
+    NetworkSpec spec(header.input_size);
+    for(std::uint32_t i{}; i < header.num_layers; i++){
+        if(table[i].activation > static_cast<std::uint32_t>(Activation::Softmax)){
+            throw std::runtime_error(path + " has an unknown activation");
+        }
+        spec.dense(table[i].units);
+        if(table[i].activation != static_cast<std::uint32_t>(Activation::Identity)){
+            spec.activation(static_cast<Activation>(table[i].activation));
+        }
+    }
+    spec.loss(static_cast<Loss>(header.loss));
+    return spec;
+}
+
+// LayerStack rejects empty layer tables and zero-width layers, which also catches a corrupt table
+static LayerStack stored_layers(const MappedFile& file, const std::string& path){
+    try {
+        return LayerStack(stored_spec(file, path));
+    } catch(const std::invalid_argument&){
+        throw std::runtime_error(path + " has an invalid layer table");
+    }
+}
+
+MappedModel::MappedModel(const std::string& path)
+    : file(std::make_shared<MappedFile>(path)), layers(stored_layers(*file, path)) {
+    const ModelFileHeader& header = checked_header(*file, path);
+    if(header.parameter_count != layers.parameter_count()){
+        throw std::runtime_error(path + " has a parameter block that does not match its layer table");
+    }
+
+    values = reinterpret_cast<const double*>(file->data() + header.parameters_offset);
+    epochs = header.epochs_completed;
+
+    // The Optimizer constructor rejects invalid settings, the state has to cover every parameter or be absent
+    optimizer_spec = OptimizerSpec{static_cast<OptimizerKind>(header.optimizer_kind), header.optimizer_settings[0],
+                                   header.optimizer_settings[1], header.optimizer_settings[2]};
+    optimizer_steps = header.optimizer_steps;
+    optimizer_values = reinterpret_cast<const double*>(file->data() + header.optimizer_offset);
+    optimizer_count = header.optimizer_count;
+    try {
+        Optimizer check(optimizer_spec);
+        if(optimizer_count != 0 && optimizer_count != check.state_slots() * header.parameter_count){
+            throw std::runtime_error(path + " has optimizer state that does not match its parameters");
+        }
+    } catch(const std::invalid_argument&){
+        throw std::runtime_error(path + " has invalid optimizer settings");
+    }
+
+    // The Normalizer constructor rejects zero or non-finite scales, which also catches a corrupt scaling block
+    if(header.num_scaled_features != 0){
+        const FeatureScaling* scaling = reinterpret_cast<const FeatureScaling*>(file->data() + header.scaling_offset);
+        try {
+            normalizer = Normalizer(std::vector<FeatureScaling>(scaling, scaling + header.num_scaled_features));
+        } catch(const std::invalid_argument&){
+            throw std::runtime_error(path + " has an invalid feature scaling");
+        }
+    }
+}
+
+Optimizer MappedModel::optimizer() const {
+    Optimizer restored(optimizer_spec);
+    restored.restore(optimizer_values, optimizer_count, optimizer_steps);
+    return restored;
+}
+
+MatrixView MappedModel::predict_batch(const MatrixView& input, InferenceWorkspace& ws) const {
+    IRIS_PROFILE_SCOPE(ProfilePhase::Inference);
+    layers.forward(input, values, ws);
+    return ws.output();
+}
@@ -1,181 +1,424 @@
 #include <cmath>
 #include "neuralNetwork.hpp"
 #include "matrix.hpp"
+#include "modelFile.hpp"
+#include "trainer.hpp"
+#include "profiler.hpp"
 #include <iostream>
+#include <algorithm>
+#include <cstring>
+
+// Random starting values between 0 and 0.1 for a weight or bias tensor of count values
+// Every tensor draws from its own engine seeded with 42, so a given network shape always starts from the same weights
+static void initial_parameters(double* values, std::size_t count){
+    std::mt19937 engine(42);
+    Matrix initial = Matrix::random(1, static_cast<unsigned int>(count), engine);
+    std::memcpy(values, initial.data(), count * sizeof(double));
+}
 
-// Sigmoid activation function that takes in a double and returns the sigmoid of that double`
-inline double sigmoid(double x) {
-    return 1.0 / (1.0 + exp(-x));
+// Relaxed atomic access to weights shared between Hogwild workers
+// GCC and Clang provide it for any trivially copyable type, on MSVC x64 an aligned 8-byte volatile access is a single move
+static inline double load_relaxed(const double* ptr){
+#if defined(__GNUC__)
+    double value;
+    __atomic_load(ptr, &value, __ATOMIC_RELAXED);
+    return value;
+#else
+    return *static_cast<const volatile double*>(ptr);
+#endif
 }
 
-// Constructor for the neural network, initializes the weights and biases of the network
-NeuralNetwork::NeuralNetwork(unsigned int input_size, unsigned int hidden_size, unsigned int output_size){
+static inline void store_relaxed(double* ptr, double value){
+#if defined(__GNUC__)
+    __atomic_store(ptr, &value, __ATOMIC_RELAXED);
+#else
+    *static_cast<volatile double*>(ptr) = value;
+#endif
+}
 
-    // Initializing the meta data for the object like the all the sizes of the intermediary layers
-    inputNum = input_size;
-    outputNum = output_size;
-    hiddenLayerNum = hidden_size;
-        
-    /// Initializing the weights and biases of the network, these are randomly generated between 0 and 0.1
-    W1 = Matrix(input_size, hidden_size);
-    W2 = Matrix(hidden_size, output_size);
-    b1 = Matrix(1, hidden_size);
-    b2 = Matrix(1, output_size);
-}
-
-NeuralNetwork::NeuralNetwork(){
-    // Default constructor, initializes the network with 4 input nodes, 5 hidden layer nodes, and 3 output nodes
-    inputNum = 4;
-    outputNum = 3;
-    hiddenLayerNum = 5;
-        
-    /// Initializing the weights and biases of the network, these are randomly generated between 0 and 0.1
-    W1 = Matrix(inputNum, hiddenLayerNum);
-    W2 = Matrix(hiddenLayerNum, outputNum);
-    b1 = Matrix(1, hiddenLayerNum);
-    b2 = Matrix(1, outputNum);
+// Snapshot shared weights into a worker's private copy
+static void copy_relaxed(const Matrix& shared, Matrix& local){
+    local.resize(shared.get_num_rows(), shared.get_num_col());
+    const double* src = shared.data();
+    double* dst = local.data();
+    for(std::size_t i = 0; i < shared.size(); i++){
+        dst[i] = load_relaxed(src + i);
+    }
 }
 
+// shared -= scale * gradient, entry by entry without a lock, a concurrent update to the same entry can be lost
+static void sub_scaled_relaxed(Matrix& shared, const Matrix& gradient, double scale){
+    double* dst = shared.data();
+    const double* grad = gradient.data();
+    for(std::size_t i = 0; i < shared.size(); i++){
+        store_relaxed(dst + i, load_relaxed(dst + i) - grad[i] * scale);
+    }
+}
+
+// Constructor for the neural network, initializes the weights and biases of every layer
+NeuralNetwork::NeuralNetwork(const NetworkSpec& spec)
+    : layers(spec), parameters(1, static_cast<unsigned int>(layers.parameter_count())),
+      epochs_completed(0), checkpoint_interval(0), num_threads(1) {
 
-// The loss/cost function that compares the output to the expected
-// In summary, this tells you how bad the network is performance wise
-double mean_squared_error(const Matrix& prediction, const Matrix& actual){
-    double error = 0.0;
-    for(unsigned int j = 0; j < prediction.get_num_col(); j++){
-        error += std::pow(prediction.get_val(0, j) - actual.get_val(0, j), 2);
+    /// Initializing the weights and biases of the network, these are randomly generated between 0 and 0.1
+    for(unsigned int layer = 0; layer < layers.num_layers(); layer++){
+        initial_parameters(parameters.data() + layers.weight_offset(layer), weights(layer).size());
+        initial_parameters(parameters.data() + layers.bias_offset(layer), bias(layer).size());
     }
-    return error / 2.0;
+
+    // The network's own workspace is laid out for single samples up front, the common case for training
+    layers.prepare(workspace, 1);
+}
+
+NeuralNetwork::NeuralNetwork(unsigned int input_size, unsigned int hidden_size, unsigned int output_size)
+    : NeuralNetwork(NetworkSpec::two_layer(input_size, hidden_size, output_size)) {
+}
+
+// Default constructor, initializes the network with 4 input nodes, 5 hidden layer nodes, and 3 output nodes
+NeuralNetwork::NeuralNetwork()
+    : NeuralNetwork(4, 5, 3) {
 }
 
 // Forward propagation function that takes in an input vector and returns the output of the network as a vector of doubles
-Matrix NeuralNetwork::forward_propagation(const Matrix& input){
+MatrixView NeuralNetwork::forward_propagation(const Matrix& input){
     // Save input for backprop
-    input_cache = input;
-    
-    // Calculate hidden layer
-    z1_cache = (input * W1) + b1;
-    a1_cache = z1_cache.apply_function(sigmoid);
+    workspace.input_cache = input;
 
-    // Calculate output layer
-    z2_cache = (a1_cache * W2) + b2;
-    Matrix a2 = z2_cache.apply_function(sigmoid);
+    layers.forward(input, parameters.data(), workspace);
+    return workspace.output();
+}
 
-    return a2;
+const Matrix& NeuralNetwork::back_propagation(const Matrix& input, const Matrix& expected_output){
+    // Every gradient is the mean over the samples in the batch
+    layers.backward(input, expected_output, parameters.data(), workspace, 1.0 / input.get_num_rows());
+    return workspace.gradients;
 }
 
-GradientStruct NeuralNetwork::back_propagation(const Matrix& input, const Matrix& expected_output){
-    Matrix A2 = z2_cache.apply_function(sigmoid);
-    
-    Matrix dZ2 = A2 - expected_output;
-    
-    Matrix dW2 = a1_cache.transpose() * dZ2;
-    
-    Matrix db2 = dZ2;
+void NeuralNetwork::set_num_threads(unsigned int threads){
+    if(threads == 0){
+        throw std::invalid_argument("Thread count must be at least 1");
+    }
 
-    Matrix ones(a1_cache.get_num_rows(), a1_cache.get_num_col(), 1.0);
+    num_threads = threads;
+    pool = threads > 1 ? std::make_shared<ThreadPool>(threads) : nullptr;
+    shard_workspaces.resize(threads > 1 ? threads : 0);
+    shard_costs.assign(threads > 1 ? threads : 0, 0.0);
+}
 
-    Matrix sigmoid_deriv = a1_cache.elementwise_multiply(ones - a1_cache);
+// A controller without validation, schedule or stopping criteria, so it runs exactly the given epochs
+void NeuralNetwork::train(const DatasetView& training_data, int epochs, double learning_rate, unsigned int batch_size){
+    if(epochs <= 0 || training_data.empty()){
+        return;
+    }
 
-    Matrix dZ1 = (dZ2 * W2.transpose()).elementwise_multiply(sigmoid_deriv);
-    
-    Matrix dW1 = input.transpose() * dZ1;
+    TrainingOptions options;
+    options.max_epochs = static_cast<unsigned int>(epochs);
+    options.learning_rate = learning_rate;
+    options.batch_size = batch_size;
 
-    Matrix db1 = dZ1;
-    
-    return GradientStruct{dW1, dW2, db1, db2};
+    TrainingController controller(*this, training_data, DatasetView(), options);
+    controller.on_epoch([](const EpochReport& report){
+        if(report.epoch % 100 == 0){
+            std::cout << "Epoch " << report.epoch << " cost: " << report.training_cost << std::endl;
+        }
+        return true;
+    });
+    controller.run();
 }
 
-void NeuralNetwork::train(const std::vector<std::vector<Record>>& training_data, int epochs, double learning_rate){
-    std::vector<Record> records = training_data[0];
+void NeuralNetwork::set_checkpointing(const std::string& path, unsigned int interval){
+    if(interval != 0 && path.empty()){
+        throw std::invalid_argument("Checkpointing needs a file path");
+    }
 
-    for(int epoch = 0; epoch < epochs; epoch++){
-        double total_cost = 0.0;
+    checkpoint_path = path;
+    checkpoint_interval = interval;
+}
 
-        for(unsigned int i = 0; i < records.size(); i++){
-            // Build input matrix for one sample
-            Matrix X(1, inputNum, 0.0);
-            X.set_val(0, 0, records[i].sepal_length);
-            X.set_val(0, 1, records[i].sepal_width);
-            X.set_val(0, 2, records[i].pedal_length);
-            X.set_val(0, 3, records[i].pedal_width);
+void NeuralNetwork::save_checkpoint() const {
+    if(checkpoint_interval != 0){
+        save(checkpoint_path);
+    }
+}
+
+void NeuralNetwork::set_parameters(const Matrix& values){
+    if(values.size() != parameters.size()){
+        throw std::invalid_argument("Parameter buffer does not match the network");
+    }
+    std::memcpy(parameters.data(), values.data(), parameters.size() * sizeof(double));
+}
+
+void NeuralNetwork::rewind(const Matrix& values, const Matrix& optimizer_state, std::uint64_t optimizer_steps, std::uint64_t epochs){
+    if(optimizer_state.size() != 0 && optimizer_state.size() != optimizer.state_slots() * parameters.size()){
+        throw std::invalid_argument("Optimizer state does not match the network");
+    }
+    set_parameters(values);
+    optimizer.restore(optimizer_state.data(), optimizer_state.size(), optimizer_steps);
+    epochs_completed = epochs;
+}
+
+void NeuralNetwork::save(const std::string& path) const {
+    IRIS_PROFILE_SCOPE(ProfilePhase::Checkpoint);
+    writeModelFile(path, layers, parameters.data(), normalizer.get_scaling(), epochs_completed, optimizer);
+}
 
-            // Build label matrix for one sample
-            Matrix Y(1, outputNum, 0.0);
-            Y.set_val(0, 0, records[i].one_hot[0]);
-            Y.set_val(0, 1, records[i].one_hot[1]);
-            Y.set_val(0, 2, records[i].one_hot[2]);
+NeuralNetwork NeuralNetwork::load(const std::string& path){
+    MappedModel model(path);
 
-            // Forward pass
-            Matrix A2 = forward_propagation(X);
+    // The constructor's random initialization is overwritten right away, it only costs one pass over the parameters
+    NeuralNetwork network(model.get_layers().get_spec());
+    std::memcpy(network.parameters.data(), model.parameters(), network.parameters.size() * sizeof(double));
+    network.normalizer = model.get_normalizer();
+    network.epochs_completed = model.epochs_completed();
+    network.optimizer = model.optimizer();
+    return network;
+}
+
+double NeuralNetwork::train_epoch(const DatasetView& samples, double learning_rate, unsigned int batch_size){
+    if(batch_size == 0){
+        throw std::invalid_argument("Batch size must be at least 1");
+    }
+
+    IRIS_PROFILE_SCOPE(ProfilePhase::Epoch);
+    double total_cost = 0.0;
+
+    for(std::size_t start = 0; start < samples.size(); start += batch_size){
+        // The last batch of an epoch may be shorter, resizing the caches down never reallocates
+        DatasetView batch;
+        {
+            IRIS_PROFILE_SCOPE(ProfilePhase::DataAssembly);
+            batch = samples.slice(start, std::min<std::size_t>(batch_size, samples.size() - start));
+        }
+        IRIS_PROFILE_COUNT(ProfileCounter::Samples, batch.size());
 
-            // Cost
-            total_cost += mean_squared_error(A2, Y);
+        if(pool && batch.size() > 1){
+            total_cost += train_batch_parallel(batch, learning_rate);
+            continue;
+        }
 
-            // Backprop and update
-            GradientStruct gradients = back_propagation(X, Y);
-            update_weights(gradients, learning_rate);
+        // Forward pass straight from the dataset's rows
+        {
+            IRIS_PROFILE_SCOPE(ProfilePhase::Forward);
+            layers.forward(batch.features(), parameters.data(), workspace);
         }
 
-        if(epoch % 100 == 0){
-            std::cout << "Epoch " << epoch << " cost: " << total_cost / records.size() << std::endl;
+        // Cost
+        {
+            IRIS_PROFILE_SCOPE(ProfilePhase::Loss);
+            total_cost += layers.loss(workspace, batch.targets());
         }
+
+        // Backprop and update, every gradient is the mean over the samples in the batch
+        {
+            IRIS_PROFILE_SCOPE(ProfilePhase::Backward);
+            layers.backward(batch.features(), batch.targets(), parameters.data(), workspace, 1.0 / batch.size());
+        }
+        update_weights(workspace.gradients, learning_rate);
     }
+
+    epochs_completed++;
+    if(checkpoint_interval != 0 && epochs_completed % checkpoint_interval == 0){
+        save(checkpoint_path);
+    }
+    return total_cost;
+}
+
+// Data-parallel step: every worker runs forward and back propagation on its own contiguous slice of the batch,
+// then the per-worker gradient sums are added up in worker order, so the result does not depend on scheduling
+double NeuralNetwork::train_batch_parallel(const DatasetView& batch, double learning_rate){
+    // Everything the tasks need is gathered here so the lambdas only capture two pointers,
+    // which keeps them inside std::function's small buffer and the step free of heap allocations
+    struct ShardJob {
+        const DatasetView& batch;
+        unsigned int shards;
+        unsigned int shard_size;
+        unsigned int remainder;
+        double batch_scale;
+    };
+    unsigned int count = static_cast<unsigned int>(batch.size());
+    unsigned int shards = std::min(num_threads, count);
+    ShardJob job{batch, shards, count / shards, count % shards, 1.0 / count};
+
+    pool->parallel_for(shards, [this, &job](unsigned int shard){
+        // The first remainder shards take one extra sample
+        unsigned int offset = shard * job.shard_size + std::min(shard, job.remainder);
+        unsigned int rows = job.shard_size + (shard < job.remainder ? 1 : 0);
+
+        TrainingWorkspace& ws = shard_workspaces[shard];
+        DatasetView slice = job.batch.slice(offset, rows);
+
+        {
+            IRIS_PROFILE_SCOPE(ProfilePhase::Forward);
+            layers.forward(slice.features(), parameters.data(), ws);
+        }
+        {
+            IRIS_PROFILE_SCOPE(ProfilePhase::Loss);
+            shard_costs[shard] = layers.loss(ws, slice.targets());
+        }
+        IRIS_PROFILE_SCOPE(ProfilePhase::Backward);
+        layers.backward(slice.features(), slice.targets(), parameters.data(), ws, 1.0);
+    });
+
+    // Reduce the flat gradient buffer in one contiguous range per thread, summing the shards in a fixed order and
+    // averaging over the batch, so every entry sees the same arithmetic whatever the range boundaries are
+    reduced_gradients.resize(1, static_cast<unsigned int>(layers.parameter_count()));
+    pool->parallel_for(num_threads, [this, &job](unsigned int task){
+        IRIS_PROFILE_SCOPE(ProfilePhase::GradientReduction);
+        std::size_t count = reduced_gradients.size();
+        std::size_t begin = count * task / num_threads;
+        std::size_t end = count * (task + 1) / num_threads;
+
+        double* total = reduced_gradients.data();
+        std::memcpy(total + begin, shard_workspaces[0].gradients.data() + begin, (end - begin) * sizeof(double));
+        for(unsigned int shard = 1; shard < job.shards; shard++){
+            const double* gradients = shard_workspaces[shard].gradients.data();
+            for(std::size_t i = begin; i < end; i++){
+                total[i] += gradients[i];
+            }
+        }
+        for(std::size_t i = begin; i < end; i++){
+            total[i] *= job.batch_scale;
+        }
+    });
+
+    update_weights(reduced_gradients, learning_rate);
+
+    double cost = 0.0;
+    for(unsigned int shard = 0; shard < shards; shard++){
+        cost += shard_costs[shard];
+    }
+    return cost;
+}
+
+
+void NeuralNetwork::test(const DatasetView& testing_data){
+    double accuracy = evaluate(testing_data);
+    std::cout << "Test accuracy: " << accuracy << "%" << std::endl;
 }
 
+double NeuralNetwork::evaluate(const DatasetView& samples) const {
+    if(samples.empty()){
+        return 0.0;
+    }
+
+    // The whole split goes through the network as one batch
+    InferenceWorkspace ws;
+    MatrixView A2 = predict_batch(samples.features(), ws);
 
-void NeuralNetwork::test(const std::vector<std::vector<Record>>& testing_data){
-    std::vector<Record> records = testing_data[1];
     int correct = 0;
+    for(unsigned int i = 0; i < samples.size(); i++){
+        // Compare the predicted class with the actual class
+        if(argmax_row(A2, i) == samples.label(i)) correct++;
+    }
 
-    for(unsigned int i = 0; i < records.size(); i++){
-        // Build input matrix for one sample
-        Matrix X(1, inputNum, 0.0);
-        X.set_val(0, 0, records[i].sepal_length);
-        X.set_val(0, 1, records[i].sepal_width);
-        X.set_val(0, 2, records[i].pedal_length);
-        X.set_val(0, 3, records[i].pedal_width);
-
-        // Build label matrix for one sample
-        Matrix Y(1, outputNum, 0.0);
-        Y.set_val(0, 0, records[i].one_hot[0]);
-        Y.set_val(0, 1, records[i].one_hot[1]);
-        Y.set_val(0, 2, records[i].one_hot[2]);
-
-        Matrix A2 = forward_propagation(X);
-
-        // Find predicted class
-        int predicted = 0;
-        double max_val = A2.get_val(0, 0);
-        for(int j = 1; j < outputNum; j++){
-            if(A2.get_val(0, j) > max_val){
-                max_val = A2.get_val(0, j);
-                predicted = j;
-            }
+    return (double)correct / samples.size() * 100.0;
+}
+
+MatrixView NeuralNetwork::predict_batch(const MatrixView& input, InferenceWorkspace& ws) const {
+    IRIS_PROFILE_SCOPE(ProfilePhase::Inference);
+    layers.forward(input, parameters.data(), ws);
+    return ws.output();
+}
+
+Matrix NeuralNetwork::predict(const MatrixView& input) const {
+    InferenceWorkspace ws;
+    return Matrix(predict_batch(input, ws));
+}
+
+unsigned int argmax_row(const MatrixView& output, unsigned int row){
+    const double* values = output.row(row);
+    unsigned int best = 0;
+    for(unsigned int j = 1; j < output.get_num_col(); j++){
+        if(values[j] > values[best]){
+            best = j;
         }
+    }
+    return best;
+}
+
+// Hogwild-style SGD: every worker keeps a private replica of the network for its caches and scratch,
+// refreshes the replica's weights from the shared ones before each sample and writes its update straight back
+// The shared weights are only ever touched through relaxed atomic loads and stores, so updates from different
+// workers may overwrite each other, which is the trade Hogwild makes for never taking a lock
+double NeuralNetwork::train_async(const DatasetView& samples, int epochs, double learning_rate, unsigned int threads){
+    if(threads == 0){
+        throw std::invalid_argument("Thread count must be at least 1");
+    }
+    // Same contract as train() and TrainingController, an empty set would also leave no average cost to return
+    if(samples.empty()){
+        throw std::invalid_argument("Training needs at least one sample");
+    }
+    if(!(learning_rate >= 0.0)){
+        throw std::invalid_argument("Learning rates cannot be negative");
+    }
+    if(optimizer.get_spec().kind != OptimizerKind::SGD){
+        throw std::logic_error("Asynchronous training only supports plain SGD");
+    }
+
+    ThreadPool workers(threads);
+    std::vector<double> worker_costs(threads, 0.0);
+
+    // Replicas are copied before any worker starts, copying inside a worker would read the shared weights with plain
+    // loads while the other workers already store to them
+    std::vector<NeuralNetwork> replicas(threads, *this);
+    for(NeuralNetwork& replica : replicas){
+        replica.set_num_threads(1);
+    }
 
-        // Find actual class
-        int actual = 0;
-        for(int j = 1; j < outputNum; j++){
-            if(Y.get_val(0, j) > Y.get_val(0, actual)){
-                actual = j;
+    workers.parallel_for(threads, [&](unsigned int worker){
+        NeuralNetwork& replica = replicas[worker];
+
+        double last_epoch_cost = 0.0;
+
+        for(int epoch = 0; epoch < epochs; epoch++){
+            last_epoch_cost = 0.0;
+
+            // Workers interleave over the samples, worker w takes samples w, w + threads, w + 2 * threads, ...
+            for(std::size_t i = worker; i < samples.size(); i += threads){
+                {
+                    IRIS_PROFILE_SCOPE(ProfilePhase::ParameterSync);
+                    copy_relaxed(parameters, replica.parameters);
+                }
+
+                DatasetView sample = samples.slice(i, 1);
+                IRIS_PROFILE_COUNT(ProfileCounter::Samples, 1);
+                {
+                    IRIS_PROFILE_SCOPE(ProfilePhase::Forward);
+                    layers.forward(sample.features(), replica.parameters.data(), replica.workspace);
+                }
+                {
+                    IRIS_PROFILE_SCOPE(ProfilePhase::Loss);
+                    last_epoch_cost += layers.loss(replica.workspace, sample.targets());
+                }
+                {
+                    IRIS_PROFILE_SCOPE(ProfilePhase::Backward);
+                    layers.backward(sample.features(), sample.targets(), replica.parameters.data(), replica.workspace, 1.0);
+                }
+                IRIS_PROFILE_SCOPE(ProfilePhase::WeightUpdate);
+                sub_scaled_relaxed(parameters, replica.workspace.gradients, learning_rate);
             }
         }
 
-        if(predicted == actual) correct++;
+        worker_costs[worker] = last_epoch_cost;
+    });
+
+    if(epochs > 0){
+        epochs_completed += static_cast<std::uint64_t>(epochs);
     }
 
-    double accuracy = (double)correct / records.size() * 100.0;
-    std::cout << "Test accuracy: " << accuracy << "%" << std::endl;
+    double total_cost = 0.0;
+    for(double cost : worker_costs){
+        total_cost += cost;
+    }
+    return total_cost / samples.size();
 }
 
 // Update the weights and biases of the network based on the calculated gradients and the learning rate
-void NeuralNetwork::update_weights(const GradientStruct& gradients, double learning_rate){
-    
-    W1 = W1 - gradients.dW1 * learning_rate;
-    b1 = b1 - gradients.db1 * learning_rate;
-    
-    W2 = W2 - gradients.dW2 * learning_rate;    
-    
-    b2 = b2 - gradients.db2 * learning_rate;
-
+// Every weight and bias is updated in one pass over the flat buffers
+void NeuralNetwork::update_weights(const Matrix& gradients, double learning_rate){
+    if(gradients.size() != parameters.size()){
+        throw std::invalid_argument("Gradients do not match the parameters of the network");
+    }
+    IRIS_PROFILE_SCOPE(ProfilePhase::WeightUpdate);
+    optimizer.step(parameters.data(), gradients.data(), parameters.size(), learning_rate);
 }
\ No newline at end of file
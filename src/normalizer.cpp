@@ -0,0 +1,141 @@
+// Normalization statistics and the column kernel that applies them
+
+#include "normalizer.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+// Rows processed per step by the vector kernel, one ymm register of doubles
+const unsigned int LANES = 4;
+
+// Reference kernel, also used for the rows left over by the vector kernel
+void normalize_scalar(const FeatureScaling* scaling, unsigned int features, double* values, std::size_t rows){
+    for(std::size_t i = 0; i < rows; i++){
+        for(unsigned int j = 0; j < features; j++){
+            values[j] = (values[j] - scaling[j].offset) / scaling[j].scale;
+        }
+        values += features;
+    }
+}
+
+#if IRIS_SIMD_X86
+
+// The rows are row-major, so feature j of consecutive samples is features apart in memory. Four rows are 4 * features
+// doubles, i.e. exactly features ymm registers, and the offset / scale of every lane repeats with that period, so with
+// the parameters expanded into that pattern the kernel streams through whole groups of four rows
+// Division rather than a reciprocal multiply keeps the result bit-identical to the scalar kernel
+IRIS_TARGET("avx2")
+void normalize_avx2(const FeatureScaling* scaling, const double* offsets, const double* scales, unsigned int features,
+                    double* values, std::size_t rows){
+    std::size_t groups = rows / LANES;
+    std::size_t group_size = static_cast<std::size_t>(features) * LANES;
+
+    for(std::size_t g = 0; g < groups; g++){
+        double* group = values + g * group_size;
+        for(unsigned int v = 0; v < features; v++){
+            __m256d x = _mm256_loadu_pd(group + v * LANES);
+            __m256d o = _mm256_loadu_pd(offsets + v * LANES);
+            __m256d s = _mm256_loadu_pd(scales + v * LANES);
+            _mm256_storeu_pd(group + v * LANES, _mm256_div_pd(_mm256_sub_pd(x, o), s));
+        }
+    }
+
+    std::size_t done = groups * LANES;
+    normalize_scalar(scaling, features, values + done * features, rows - done);
+}
+
+#endif
+
+// Running statistics of one feature, Welford's update keeps the variance accurate in a single pass
+struct FeatureStats {
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+    double mean = 0.0;
+    double m2 = 0.0;
+};
+
+}
+
+Normalizer::Normalizer(){
+}
+
+Normalizer::Normalizer(std::vector<FeatureScaling> values)
+    : scaling(std::move(values)) {
+
+    for(const FeatureScaling& feature : scaling){
+        if(feature.scale == 0.0 || !std::isfinite(feature.scale) || !std::isfinite(feature.offset)){
+            throw std::invalid_argument("Feature scaling must be finite with a non-zero scale");
+        }
+    }
+
+    lane_offsets.resize(scaling.size() * LANES);
+    lane_scales.resize(scaling.size() * LANES);
+    for(std::size_t t = 0; t < lane_offsets.size(); t++){
+        lane_offsets[t] = scaling[t % scaling.size()].offset;
+        lane_scales[t] = scaling[t % scaling.size()].scale;
+    }
+}
+
+Normalizer Normalizer::fit(const DatasetView& samples, NormalizationMethod method){
+    if(samples.empty()){
+        throw std::invalid_argument("Cannot fit a normalizer on an empty dataset");
+    }
+
+    unsigned int features = samples.num_features();
+    std::vector<FeatureStats> stats(features);
+
+    for(std::size_t i = 0; i < samples.size(); i++){
+        const double* row = samples.feature_row(i);
+        double count = static_cast<double>(i + 1);
+        for(unsigned int j = 0; j < features; j++){
+            FeatureStats& s = stats[j];
+            double x = row[j];
+            s.min = std::min(s.min, x);
+            s.max = std::max(s.max, x);
+
+            double delta = x - s.mean;
+            s.mean += delta / count;
+            s.m2 += delta * (x - s.mean);
+        }
+    }
+
+    std::vector<FeatureScaling> scaling(features);
+    for(unsigned int j = 0; j < features; j++){
+        const FeatureStats& s = stats[j];
+        double offset = method == NormalizationMethod::MinMax ? s.min : s.mean;
+        double scale = method == NormalizationMethod::MinMax ? s.max - s.min : std::sqrt(s.m2 / samples.size());
+        scaling[j] = FeatureScaling{offset, scale > 0.0 ? scale : 1.0};
+    }
+
+    return Normalizer(std::move(scaling));
+}
+
+void Normalizer::apply(double* values, std::size_t rows) const {
+    if(scaling.empty()){
+        return;
+    }
+
+#if IRIS_SIMD_X86
+    if(rows >= LANES && vector_kernels_enabled()){
+        normalize_avx2(scaling.data(), lane_offsets.data(), lane_scales.data(), num_features(), values, rows);
+        return;
+    }
+#endif
+    normalize_scalar(scaling.data(), num_features(), values, rows);
+}
+
+void Normalizer::apply(Dataset& data) const {
+    if(scaling.empty()){
+        return;
+    }
+    if(data.num_features() != num_features()){
+        throw std::invalid_argument("Normalizer and dataset have a different number of features");
+    }
+
+    apply(data.mutable_features(), data.size());
+}
@@ -0,0 +1,229 @@
+// Fused optimizer updates over the flat parameter buffer, a scalar loop and an AVX2 kernel for every rule
+
+#include "optimizer.hpp"
+#include "simd.hpp"
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+// Values processed per step by the vector kernels, one ymm register of doubles
+const unsigned int LANES = 4;
+
+// Every kernel reads each parameter, gradient and state value once and writes it back once
+
+// SGD has no vector kernel of its own: the compiler vectorizes this loop for the build's target, and a kernel compiled
+// for FMA would be free to fuse the multiply and subtract, changing the results of the plain gradient descent the
+// network always used in the last bits
+
+void sgd_scalar(double* p, const double* g, std::size_t count, double lr){
+    for(std::size_t i = 0; i < count; i++){
+        p[i] -= g[i] * lr;
+    }
+}
+
+void momentum_scalar(double* p, const double* g, double* v, std::size_t count, double lr, double beta){
+    for(std::size_t i = 0; i < count; i++){
+        v[i] = beta * v[i] + g[i];
+        p[i] -= lr * v[i];
+    }
+}
+
+void rmsprop_scalar(double* p, const double* g, double* s, std::size_t count, double lr, double decay, double epsilon){
+    for(std::size_t i = 0; i < count; i++){
+        s[i] = decay * s[i] + (1.0 - decay) * g[i] * g[i];
+        p[i] -= lr * g[i] / (std::sqrt(s[i]) + epsilon);
+    }
+}
+
+// step_size already carries the bias correction of both moments
+void adam_scalar(double* p, const double* g, double* m, double* v, std::size_t count, double step_size,
+                 double beta1, double beta2, double epsilon){
+    for(std::size_t i = 0; i < count; i++){
+        m[i] = beta1 * m[i] + (1.0 - beta1) * g[i];
+        v[i] = beta2 * v[i] + (1.0 - beta2) * g[i] * g[i];
+        p[i] -= step_size * m[i] / (std::sqrt(v[i]) + epsilon);
+    }
+}
+
+#if IRIS_SIMD_X86
+
+// The vector kernels return how many values they handled, the caller finishes the rest with the scalar loop
+
+IRIS_TARGET("avx2,fma")
+std::size_t momentum_avx2(double* p, const double* g, double* v, std::size_t count, double lr, double beta){
+    const __m256d rate = _mm256_set1_pd(lr);
+    const __m256d decay = _mm256_set1_pd(beta);
+    std::size_t i = 0;
+    for(; i + LANES <= count; i += LANES){
+        __m256d velocity = _mm256_fmadd_pd(decay, _mm256_loadu_pd(v + i), _mm256_loadu_pd(g + i));
+        _mm256_storeu_pd(v + i, velocity);
+        _mm256_storeu_pd(p + i, _mm256_fnmadd_pd(rate, velocity, _mm256_loadu_pd(p + i)));
+    }
+    return i;
+}
+
+IRIS_TARGET("avx2,fma")
+std::size_t rmsprop_avx2(double* p, const double* g, double* s, std::size_t count, double lr, double decay, double epsilon){
+    const __m256d rate = _mm256_set1_pd(lr);
+    const __m256d keep = _mm256_set1_pd(decay);
+    const __m256d blend = _mm256_set1_pd(1.0 - decay);
+    const __m256d eps = _mm256_set1_pd(epsilon);
+    std::size_t i = 0;
+    for(; i + LANES <= count; i += LANES){
+        __m256d gradient = _mm256_loadu_pd(g + i);
+        __m256d square = _mm256_mul_pd(blend, _mm256_mul_pd(gradient, gradient));
+        __m256d mean_square = _mm256_fmadd_pd(keep, _mm256_loadu_pd(s + i), square);
+        _mm256_storeu_pd(s + i, mean_square);
+
+        __m256d denominator = _mm256_add_pd(_mm256_sqrt_pd(mean_square), eps);
+        __m256d update = _mm256_div_pd(_mm256_mul_pd(rate, gradient), denominator);
+        _mm256_storeu_pd(p + i, _mm256_sub_pd(_mm256_loadu_pd(p + i), update));
+    }
+    return i;
+}
+
+IRIS_TARGET("avx2,fma")
+std::size_t adam_avx2(double* p, const double* g, double* m, double* v, std::size_t count, double step_size,
+                      double beta1, double beta2, double epsilon){
+    const __m256d rate = _mm256_set1_pd(step_size);
+    const __m256d keep1 = _mm256_set1_pd(beta1);
+    const __m256d blend1 = _mm256_set1_pd(1.0 - beta1);
+    const __m256d keep2 = _mm256_set1_pd(beta2);
+    const __m256d blend2 = _mm256_set1_pd(1.0 - beta2);
+    const __m256d eps = _mm256_set1_pd(epsilon);
+    std::size_t i = 0;
+    for(; i + LANES <= count; i += LANES){
+        __m256d gradient = _mm256_loadu_pd(g + i);
+        __m256d mean = _mm256_fmadd_pd(keep1, _mm256_loadu_pd(m + i), _mm256_mul_pd(blend1, gradient));
+        __m256d square = _mm256_mul_pd(blend2, _mm256_mul_pd(gradient, gradient));
+        __m256d mean_square = _mm256_fmadd_pd(keep2, _mm256_loadu_pd(v + i), square);
+        _mm256_storeu_pd(m + i, mean);
+        _mm256_storeu_pd(v + i, mean_square);
+
+        __m256d denominator = _mm256_add_pd(_mm256_sqrt_pd(mean_square), eps);
+        __m256d update = _mm256_div_pd(_mm256_mul_pd(rate, mean), denominator);
+        _mm256_storeu_pd(p + i, _mm256_sub_pd(_mm256_loadu_pd(p + i), update));
+    }
+    return i;
+}
+
+#endif
+
+bool valid_decay(double decay){
+    return decay >= 0.0 && decay < 1.0;
+}
+
+}
+
+OptimizerSpec OptimizerSpec::sgd(){
+    return OptimizerSpec{OptimizerKind::SGD, 0.0, 0.0, 0.0};
+}
+
+OptimizerSpec OptimizerSpec::momentum(double beta){
+    return OptimizerSpec{OptimizerKind::Momentum, beta, 0.0, 0.0};
+}
+
+OptimizerSpec OptimizerSpec::rmsprop(double decay, double epsilon){
+    return OptimizerSpec{OptimizerKind::RMSProp, 0.0, decay, epsilon};
+}
+
+OptimizerSpec OptimizerSpec::adam(double beta1, double beta2, double epsilon){
+    return OptimizerSpec{OptimizerKind::Adam, beta1, beta2, epsilon};
+}
+
+const char* optimizer_name(OptimizerKind kind){
+    switch(kind){
+        case OptimizerKind::SGD: return "sgd";
+        case OptimizerKind::Momentum: return "momentum";
+        case OptimizerKind::RMSProp: return "rmsprop";
+        case OptimizerKind::Adam: return "adam";
+    }
+    return "unknown";
+}
+
+Optimizer::Optimizer(const OptimizerSpec& spec)
+    : spec(spec), steps(0) {
+    bool uses_epsilon = spec.kind == OptimizerKind::RMSProp || spec.kind == OptimizerKind::Adam;
+    if(!valid_decay(spec.beta1) || !valid_decay(spec.beta2) || (uses_epsilon && !(spec.epsilon > 0.0))){
+        throw std::invalid_argument("Optimizer decays must lie in [0, 1) and epsilon must be positive");
+    }
+}
+
+unsigned int Optimizer::state_slots() const {
+    switch(spec.kind){
+        case OptimizerKind::SGD: return 0;
+        case OptimizerKind::Momentum: return 1;
+        case OptimizerKind::RMSProp: return 1;
+        case OptimizerKind::Adam: return 2;
+    }
+    return 0;
+}
+
+void Optimizer::step(double* parameters, const double* gradients, std::size_t count, double learning_rate){
+    std::size_t state_size = state_slots() * count;
+    if(state.size() != state_size){
+        if(state.size() != 0){
+            throw std::invalid_argument("Optimizer state does not match the number of parameters");
+        }
+        state = Matrix(1, static_cast<unsigned int>(state_size));
+    }
+    steps++;
+
+    double* first = state.data();
+    double* second = state.data() + count;
+    bool vector = vector_kernels_enabled();
+    std::size_t done = 0;
+
+    switch(spec.kind){
+        case OptimizerKind::SGD:
+            sgd_scalar(parameters, gradients, count, learning_rate);
+            break;
+
+        case OptimizerKind::Momentum:
+#if IRIS_SIMD_X86
+            if(vector) done = momentum_avx2(parameters, gradients, first, count, learning_rate, spec.beta1);
+#endif
+            momentum_scalar(parameters + done, gradients + done, first + done, count - done, learning_rate, spec.beta1);
+            break;
+
+        case OptimizerKind::RMSProp:
+#if IRIS_SIMD_X86
+            if(vector) done = rmsprop_avx2(parameters, gradients, first, count, learning_rate, spec.beta2, spec.epsilon);
+#endif
+            rmsprop_scalar(parameters + done, gradients + done, first + done, count - done, learning_rate, spec.beta2, spec.epsilon);
+            break;
+
+        case OptimizerKind::Adam: {
+            // The bias correction of both moments is folded into the step size once per step instead of per value
+            double t = static_cast<double>(steps);
+            double step_size = learning_rate * std::sqrt(1.0 - std::pow(spec.beta2, t)) / (1.0 - std::pow(spec.beta1, t));
+#if IRIS_SIMD_X86
+            if(vector) done = adam_avx2(parameters, gradients, first, second, count, step_size, spec.beta1, spec.beta2, spec.epsilon);
+#endif
+            adam_scalar(parameters + done, gradients + done, first + done, second + done, count - done, step_size,
+                        spec.beta1, spec.beta2, spec.epsilon);
+            break;
+        }
+    }
+    (void)vector;
+}
+
+void Optimizer::restore(const double* values, std::size_t count, std::uint64_t steps_taken){
+    if(count == 0){
+        state = Matrix();
+    } else {
+        if(state_slots() == 0 || count % state_slots() != 0){
+            throw std::invalid_argument("Saved state does not fit the optimizer");
+        }
+        state.resize(1, static_cast<unsigned int>(count));
+        std::memcpy(state.data(), values, count * sizeof(double));
+    }
+    steps = steps_taken;
+}
+
+void Optimizer::reset(){
+    state = Matrix();
+    steps = 0;
+}
@@ -0,0 +1,311 @@
+// Thread-local phase timers and counters, summed across threads when a report is made
+
+#include "profiler.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+struct TraceEvent {
+    ProfilePhase phase;
+    std::uint64_t start;
+    std::uint64_t end;
+};
+
+// Only its own thread writes to a profile, so plain relaxed loads and stores are enough for the totals and a snapshot
+// taken from another thread still reads whole values. Aligned so no two threads' profiles share a cache line
+struct alignas(64) ThreadProfile {
+    std::atomic<std::uint64_t> ticks[PROFILE_PHASES];
+    std::atomic<std::uint64_t> calls[PROFILE_PHASES];
+    std::atomic<std::uint64_t> counters[PROFILE_COUNTERS];
+
+    // Only taken while tracing, and by write_chrome_trace
+    std::mutex events_mutex;
+    std::vector<TraceEvent> events;
+
+    unsigned int thread_id;
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<ThreadProfile*> live;
+
+    // Totals and events of threads that have exited since the last reset
+    std::uint64_t retired_ticks[PROFILE_PHASES] = {};
+    std::uint64_t retired_calls[PROFILE_PHASES] = {};
+    std::uint64_t retired_counters[PROFILE_COUNTERS] = {};
+    std::vector<std::pair<unsigned int, TraceEvent>> retired_events;
+
+    unsigned int next_thread_id = 1;
+
+    // Tick and clock readings at the last reset, the two elapsed spans give the length of a tick
+    std::uint64_t origin_ticks;
+    std::uint64_t origin_ns;
+
+    std::atomic<bool> tracing{false};
+    std::atomic<std::size_t> max_events{0};
+};
+
+std::uint64_t ticks(){
+#if defined(IRIS_PROFILING)
+    return profile_ticks();
+#else
+    return profile_ticks_now();
+#endif
+}
+
+// Never destroyed, thread_local profiles can still retire into it while the process exits
+Registry& registry(){
+    static Registry* instance = [](){
+        Registry* created = new Registry();
+        created->origin_ticks = ticks();
+        created->origin_ns = profile_ticks_now();
+        return created;
+    }();
+    return *instance;
+}
+
+void add_relaxed(std::atomic<std::uint64_t>& total, std::uint64_t amount){
+    total.store(total.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+// Registers the calling thread's profile on first use and folds it into the retired totals when the thread exits
+struct ThreadSlot {
+    ThreadProfile* profile;
+
+    ThreadSlot() : profile(new ThreadProfile()) {
+        for(auto& value : profile->ticks) value.store(0, std::memory_order_relaxed);
+        for(auto& value : profile->calls) value.store(0, std::memory_order_relaxed);
+        for(auto& value : profile->counters) value.store(0, std::memory_order_relaxed);
+
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        profile->thread_id = reg.next_thread_id++;
+        reg.live.push_back(profile);
+    }
+
+    ~ThreadSlot(){
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        for(unsigned int i = 0; i < PROFILE_PHASES; i++){
+            reg.retired_ticks[i] += profile->ticks[i].load(std::memory_order_relaxed);
+            reg.retired_calls[i] += profile->calls[i].load(std::memory_order_relaxed);
+        }
+        for(unsigned int i = 0; i < PROFILE_COUNTERS; i++){
+            reg.retired_counters[i] += profile->counters[i].load(std::memory_order_relaxed);
+        }
+        {
+            std::lock_guard<std::mutex> events_lock(profile->events_mutex);
+            for(const TraceEvent& event : profile->events){
+                reg.retired_events.emplace_back(profile->thread_id, event);
+            }
+        }
+        reg.live.erase(std::find(reg.live.begin(), reg.live.end(), profile));
+        delete profile;
+    }
+};
+
+ThreadProfile& local_profile(){
+    thread_local ThreadSlot slot;
+    return *slot.profile;
+}
+
+// Nanoseconds per tick measured over the time since the last reset, the caller holds the registry lock
+double ns_per_tick(const Registry& reg){
+    std::uint64_t elapsed_ticks = ticks() - reg.origin_ticks;
+    std::uint64_t elapsed_ns = profile_ticks_now() - reg.origin_ns;
+    return elapsed_ticks == 0 ? 1.0 : static_cast<double>(elapsed_ns) / static_cast<double>(elapsed_ticks);
+}
+
+}
+
+const char* profile_phase_name(ProfilePhase phase){
+    switch(phase){
+        case ProfilePhase::Epoch: return "epoch";
+        case ProfilePhase::DataAssembly: return "data_assembly";
+        case ProfilePhase::Forward: return "forward";
+        case ProfilePhase::Loss: return "loss";
+        case ProfilePhase::Backward: return "backward";
+        case ProfilePhase::GradientReduction: return "gradient_reduction";
+        case ProfilePhase::WeightUpdate: return "weight_update";
+        case ProfilePhase::ParameterSync: return "parameter_sync";
+        case ProfilePhase::Validation: return "validation";
+        case ProfilePhase::Inference: return "inference";
+        case ProfilePhase::Checkpoint: return "checkpoint";
+        case ProfilePhase::DataLoad: return "data_load";
+        case ProfilePhase::Count: break;
+    }
+    return "unknown";
+}
+
+const char* profile_counter_name(ProfileCounter counter){
+    switch(counter){
+        case ProfileCounter::Samples: return "samples";
+        case ProfileCounter::MatrixConstructions: return "matrix_constructions";
+        case ProfileCounter::MatrixAllocations: return "matrix_allocations";
+        case ProfileCounter::BytesAllocated: return "bytes_allocated";
+        case ProfileCounter::Count: break;
+    }
+    return "unknown";
+}
+
+bool profiling_compiled_in(){
+#if defined(IRIS_PROFILING)
+    return true;
+#else
+    return false;
+#endif
+}
+
+std::uint64_t profile_ticks_now(){
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void profile_record_phase(ProfilePhase phase, std::uint64_t start_ticks, std::uint64_t end_ticks){
+    ThreadProfile& profile = local_profile();
+    unsigned int index = static_cast<unsigned int>(phase);
+    add_relaxed(profile.ticks[index], end_ticks - start_ticks);
+    add_relaxed(profile.calls[index], 1);
+
+    Registry& reg = registry();
+    if(reg.tracing.load(std::memory_order_relaxed)){
+        std::lock_guard<std::mutex> lock(profile.events_mutex);
+        if(profile.events.size() < reg.max_events.load(std::memory_order_relaxed)){
+            profile.events.push_back(TraceEvent{phase, start_ticks, end_ticks});
+        }
+    }
+}
+
+void profile_add(ProfileCounter counter, std::uint64_t amount){
+    add_relaxed(local_profile().counters[static_cast<unsigned int>(counter)], amount);
+}
+
+ProfileReport profile_snapshot(){
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    std::uint64_t ticks_total[PROFILE_PHASES];
+    ProfileReport report{};
+    for(unsigned int i = 0; i < PROFILE_PHASES; i++){
+        ticks_total[i] = reg.retired_ticks[i];
+        report.phase_calls[i] = reg.retired_calls[i];
+    }
+    for(unsigned int i = 0; i < PROFILE_COUNTERS; i++){
+        report.counters[i] = reg.retired_counters[i];
+    }
+
+    for(ThreadProfile* profile : reg.live){
+        for(unsigned int i = 0; i < PROFILE_PHASES; i++){
+            ticks_total[i] += profile->ticks[i].load(std::memory_order_relaxed);
+            report.phase_calls[i] += profile->calls[i].load(std::memory_order_relaxed);
+        }
+        for(unsigned int i = 0; i < PROFILE_COUNTERS; i++){
+            report.counters[i] += profile->counters[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    double scale = ns_per_tick(reg);
+    for(unsigned int i = 0; i < PROFILE_PHASES; i++){
+        report.phase_ns[i] = static_cast<std::uint64_t>(ticks_total[i] * scale);
+    }
+    report.wall_ns = profile_ticks_now() - reg.origin_ns;
+    return report;
+}
+
+void profile_reset(){
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    for(ThreadProfile* profile : reg.live){
+        for(auto& value : profile->ticks) value.store(0, std::memory_order_relaxed);
+        for(auto& value : profile->calls) value.store(0, std::memory_order_relaxed);
+        for(auto& value : profile->counters) value.store(0, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> events_lock(profile->events_mutex);
+        profile->events.clear();
+    }
+    std::fill(std::begin(reg.retired_ticks), std::end(reg.retired_ticks), 0);
+    std::fill(std::begin(reg.retired_calls), std::end(reg.retired_calls), 0);
+    std::fill(std::begin(reg.retired_counters), std::end(reg.retired_counters), 0);
+    reg.retired_events.clear();
+
+    reg.origin_ticks = ticks();
+    reg.origin_ns = profile_ticks_now();
+}
+
+void profile_set_tracing(bool enabled, std::size_t max_events){
+    Registry& reg = registry();
+    reg.max_events.store(max_events, std::memory_order_relaxed);
+    reg.tracing.store(enabled, std::memory_order_relaxed);
+}
+
+void write_profile_json(std::ostream& out, const ProfileReport& report){
+    char line[256];
+    out << "{\n";
+    std::snprintf(line, sizeof(line), "  \"profiling_compiled_in\": %s,\n  \"wall_ns\": %llu,\n",
+                  profiling_compiled_in() ? "true" : "false", static_cast<unsigned long long>(report.wall_ns));
+    out << line;
+
+    out << "  \"phases\": {\n";
+    for(unsigned int i = 0; i < PROFILE_PHASES; i++){
+        double per_call = report.phase_calls[i] == 0 ? 0.0 : static_cast<double>(report.phase_ns[i]) / report.phase_calls[i];
+        std::snprintf(line, sizeof(line), "    \"%s\": {\"ns\": %llu, \"calls\": %llu, \"ns_per_call\": %.1f}%s\n",
+                      profile_phase_name(static_cast<ProfilePhase>(i)), static_cast<unsigned long long>(report.phase_ns[i]),
+                      static_cast<unsigned long long>(report.phase_calls[i]), per_call, i + 1 < PROFILE_PHASES ? "," : "");
+        out << line;
+    }
+    out << "  },\n";
+
+    // Counters per weight update (one training step) and per epoch
+    std::uint64_t updates = report.phase_calls[static_cast<unsigned int>(ProfilePhase::WeightUpdate)];
+    std::uint64_t epochs = report.phase_calls[static_cast<unsigned int>(ProfilePhase::Epoch)];
+    out << "  \"counters\": {\n";
+    for(unsigned int i = 0; i < PROFILE_COUNTERS; i++){
+        double total = static_cast<double>(report.counters[i]);
+        std::snprintf(line, sizeof(line), "    \"%s\": {\"total\": %llu, \"per_update\": %.2f, \"per_epoch\": %.2f}%s\n",
+                      profile_counter_name(static_cast<ProfileCounter>(i)), static_cast<unsigned long long>(report.counters[i]),
+                      updates == 0 ? 0.0 : total / updates, epochs == 0 ? 0.0 : total / epochs, i + 1 < PROFILE_COUNTERS ? "," : "");
+        out << line;
+    }
+    out << "  },\n";
+
+    std::uint64_t epoch_ns = report.phase_ns[static_cast<unsigned int>(ProfilePhase::Epoch)];
+    std::uint64_t samples = report.counters[static_cast<unsigned int>(ProfileCounter::Samples)];
+    std::snprintf(line, sizeof(line), "  \"samples_per_second\": %.1f\n", epoch_ns == 0 ? 0.0 : samples * 1e9 / epoch_ns);
+    out << line << "}\n";
+}
+
+void write_chrome_trace(std::ostream& out){
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    double scale = ns_per_tick(reg);
+    bool first = true;
+    char line[256];
+
+    // Complete events ("ph": "X") with microsecond timestamps relative to the last reset
+    auto write_event = [&](unsigned int thread_id, const TraceEvent& event){
+        double start = event.start >= reg.origin_ticks ? (event.start - reg.origin_ticks) * scale / 1000.0 : 0.0;
+        double duration = (event.end - event.start) * scale / 1000.0;
+        std::snprintf(line, sizeof(line), "%s\n    {\"name\": \"%s\", \"cat\": \"iris\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %u}",
+                      first ? "" : ",", profile_phase_name(event.phase), start, duration, thread_id);
+        out << line;
+        first = false;
+    };
+
+    out << "{\n  \"displayTimeUnit\": \"ns\",\n  \"traceEvents\": [";
+    for(const auto& retired : reg.retired_events){
+        write_event(retired.first, retired.second);
+    }
+    for(ThreadProfile* profile : reg.live){
+        std::lock_guard<std::mutex> events_lock(profile->events_mutex);
+        for(const TraceEvent& event : profile->events){
+            write_event(profile->thread_id, event);
+        }
+    }
+    out << "\n  ]\n}\n";
+}
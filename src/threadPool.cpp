@@ -0,0 +1,113 @@
+// Small fork/join thread pool used by the data-parallel trainer
+
+#include "threadPool.hpp"
+
+ThreadPool::ThreadPool(unsigned int num_threads)
+    : current_task(nullptr), task_count(0), next_task(0), completed_tasks(0), generation(0), stopping(false) {
+
+    for(unsigned int i = 1; i < num_threads; i++){
+        workers.emplace_back(&ThreadPool::worker_loop, this);
+    }
+}
+
+ThreadPool::~ThreadPool(){
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        stopping = true;
+    }
+    work_ready.notify_all();
+
+    for(std::thread& worker : workers){
+        worker.join();
+    }
+}
+
+void ThreadPool::parallel_for(unsigned int count, const std::function<void(unsigned int)>& task){
+    if(count == 0){
+        return;
+    }
+
+    std::lock_guard<std::mutex> job_lock(job_mutex);
+
+    // Nothing to share the work with, skip the hand-off entirely
+    if(workers.empty() || count == 1){
+        for(unsigned int i = 0; i < count; i++){
+            task(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        current_task = &task;
+        task_count = count;
+        next_task = 0;
+        completed_tasks = 0;
+        first_error = nullptr;
+        generation++;
+    }
+    work_ready.notify_all();
+
+    // The calling thread works through the queue too instead of idling
+    run_tasks();
+
+    std::exception_ptr error;
+    {
+        std::unique_lock<std::mutex> lock(state_mutex);
+        work_done.wait(lock, [this]{ return completed_tasks == task_count; });
+        current_task = nullptr;
+        error = first_error;
+    }
+
+    if(error){
+        std::rethrow_exception(error);
+    }
+}
+
+// Claim task indices until the current job has none left
+void ThreadPool::run_tasks(){
+    while(true){
+        const std::function<void(unsigned int)>* task;
+        unsigned int index;
+        {
+            std::lock_guard<std::mutex> lock(state_mutex);
+            if(current_task == nullptr || next_task >= task_count){
+                return;
+            }
+            task = current_task;
+            index = next_task++;
+        }
+
+        std::exception_ptr error;
+        try {
+            (*task)(index);
+        } catch(...) {
+            error = std::current_exception();
+        }
+
+        std::lock_guard<std::mutex> lock(state_mutex);
+        if(error && !first_error){
+            first_error = error;
+        }
+        if(++completed_tasks == task_count){
+            work_done.notify_one();
+        }
+    }
+}
+
+void ThreadPool::worker_loop(){
+    std::uint64_t seen_generation = 0;
+
+    while(true){
+        {
+            std::unique_lock<std::mutex> lock(state_mutex);
+            work_ready.wait(lock, [&]{ return stopping || generation != seen_generation; });
+            if(stopping){
+                return;
+            }
+            seen_generation = generation;
+        }
+
+        run_tasks();
+    }
+}
@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include "trainer.hpp"
+#include "neuralNetwork.hpp"
+#include "profiler.hpp"
+
+const char* stop_reason_name(StopReason reason){
+    switch(reason){
+        case StopReason::MaxEpochs: return "epoch limit reached";
+        case StopReason::EarlyStopping: return "stopped improving";
+        case StopReason::TimeBudget: return "time budget spent";
+        case StopReason::Callback: return "stopped by callback";
+    }
+    return "unknown";
+}
+
+ValidationSplit hold_out(const DatasetView& samples, double fraction){
+    if(!(fraction > 0.0 && fraction < 1.0)){
+        throw std::invalid_argument("The validation fraction must lie strictly between 0 and 1");
+    }
+
+    std::size_t held = static_cast<std::size_t>(std::round(samples.size() * fraction));
+    if(held == 0 || held >= samples.size()){
+        throw std::invalid_argument("Too few samples to hold out a validation set");
+    }
+
+    std::size_t kept = samples.size() - held;
+    return ValidationSplit{samples.slice(0, kept), samples.slice(kept, held)};
+}
+
+TrainingController::TrainingController(NeuralNetwork& network, const DatasetView& training, const DatasetView& validation, const TrainingOptions& options)
+    : network(network), training(training), validation(validation), options(options), started(false), done(false),
+      learning_rate(options.learning_rate), epochs_since_best(0), keep_best(options.patience != 0 && options.restore_best),
+      best_optimizer_steps(0), best_epochs_completed(0), report{} {
+    if(training.empty()){
+        throw std::invalid_argument("Training needs at least one sample");
+    }
+    if(options.batch_size == 0){
+        throw std::invalid_argument("Batch size must be at least 1");
+    }
+    // A rate of 0 is allowed and trains without learning, the costs are still computed and reported
+    if(!(options.learning_rate >= 0.0) || options.min_learning_rate < 0.0 || options.min_learning_rate > options.learning_rate){
+        throw std::invalid_argument("Learning rates cannot be negative and min_learning_rate must be at most learning_rate");
+    }
+    if(!(options.decay > 0.0 && options.decay <= 1.0) || options.decay_epochs == 0){
+        throw std::invalid_argument("Learning rate decay must lie in (0, 1] over at least one epoch");
+    }
+    if(options.min_delta < 0.0 || options.time_budget_seconds < 0.0){
+        throw std::invalid_argument("min_delta and the time budget cannot be negative");
+    }
+}
+
+double TrainingController::scheduled_rate(unsigned int epoch) const {
+    double rate = options.learning_rate;
+    switch(options.schedule){
+        case LearningRateSchedule::Constant:
+        case LearningRateSchedule::ReduceOnPlateau:
+            return learning_rate;
+        case LearningRateSchedule::Step:
+            rate *= std::pow(options.decay, static_cast<double>(epoch / options.decay_epochs));
+            break;
+        case LearningRateSchedule::Exponential:
+            rate *= std::pow(options.decay, static_cast<double>(epoch) / options.decay_epochs);
+            break;
+        case LearningRateSchedule::Cosine: {
+            const double pi = 3.14159265358979323846;
+            double progress = std::min(1.0, static_cast<double>(epoch) / std::max(1u, options.max_epochs));
+            rate = options.min_learning_rate + (options.learning_rate - options.min_learning_rate) * 0.5 * (1.0 + std::cos(pi * progress));
+            break;
+        }
+    }
+    return std::max(rate, options.min_learning_rate);
+}
+
+bool TrainingController::step(){
+    if(done){
+        return false;
+    }
+    if(!started){
+        start = std::chrono::steady_clock::now();
+        started = true;
+    }
+    if(result.epochs_run >= options.max_epochs){
+        finish(StopReason::MaxEpochs);
+        return false;
+    }
+
+    double rate = learning_rate;
+    double training_cost = network.train_epoch(training, rate, options.batch_size) / training.size();
+    result.epochs_run++;
+
+    // One batched forward pass over the validation set, its workspace is reused from epoch to epoch
+    double monitored_loss = training_cost;
+    if(!validation.empty()){
+        IRIS_PROFILE_SCOPE(ProfilePhase::Validation);
+        network.predict_batch(validation.features(), validation_ws);
+        monitored_loss = network.get_layers().loss(validation_ws, validation.targets()) / validation.size();
+    }
+
+    std::uint64_t epoch = network.get_epochs_completed() - 1;
+    bool improved = result.epochs_run == 1 || monitored_loss < result.best_loss - options.min_delta;
+    if(improved){
+        result.best_loss = monitored_loss;
+        result.best_epoch = epoch;
+        epochs_since_best = 0;
+
+        if(keep_best){
+            const Matrix& parameters = network.get_parameters();
+            best_parameters.resize(parameters.get_num_rows(), parameters.get_num_col());
+            std::memcpy(best_parameters.data(), parameters.data(), parameters.size() * sizeof(double));
+
+            const Optimizer& optimizer = network.get_optimizer();
+            const Matrix& state = optimizer.get_state();
+            best_optimizer_state.resize(state.get_num_rows(), state.get_num_col());
+            std::memcpy(best_optimizer_state.data(), state.data(), state.size() * sizeof(double));
+            best_optimizer_steps = optimizer.get_steps();
+            best_epochs_completed = network.get_epochs_completed();
+        }
+    } else {
+        epochs_since_best++;
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    report = EpochReport{epoch, result.epochs_run, training_cost, monitored_loss, rate, improved, elapsed};
+    result.elapsed_seconds = elapsed;
+
+    // Rate for the next epoch
+    if(options.schedule == LearningRateSchedule::ReduceOnPlateau){
+        if(!improved && epochs_since_best % options.decay_epochs == 0){
+            learning_rate = std::max(learning_rate * options.decay, options.min_learning_rate);
+        }
+    } else {
+        learning_rate = scheduled_rate(result.epochs_run);
+    }
+
+    if(epoch_callback && !epoch_callback(report)){
+        finish(StopReason::Callback);
+    } else if(options.patience != 0 && epochs_since_best >= options.patience){
+        finish(StopReason::EarlyStopping);
+    } else if(options.time_budget_seconds > 0.0 && elapsed >= options.time_budget_seconds){
+        finish(StopReason::TimeBudget);
+    } else if(result.epochs_run >= options.max_epochs){
+        finish(StopReason::MaxEpochs);
+    }
+    return true;
+}
+
+const TrainingResult& TrainingController::run(){
+    while(step()){
+    }
+    return result;
+}
+
+void TrainingController::finish(StopReason reason){
+    if(reason == StopReason::EarlyStopping && keep_best){
+        network.rewind(best_parameters, best_optimizer_state, best_optimizer_steps, best_epochs_completed);
+    }
+
+    result.reason = reason;
+    done = true;
+
+    // The last epoch has to make it into the checkpoint too, after a restore that is the best epoch with its own
+    // optimizer state and epoch count
+    if(result.epochs_run > 0){
+        network.save_checkpoint();
+    }
+}
@@ -1,6 +1,11 @@
 #include "visualizer.hpp"
+#include "backgroundTrainer.hpp"
+#include "decisionMap.hpp"
 #include <SFML/Graphics.hpp>
 #include <cmath>
+#include <cstdio>
+#include <exception>
+#include <memory>
 #include <string>
 #include <vector>
 #include <functional>
@@ -16,9 +21,16 @@ static const sf::Color ORANGE_DIM      = {180, 100, 0};
 static const sf::Color TEXT_DIM        = {160, 160, 160};
 
 static const float NODE_RADIUS   = 28.f;
-static const float WINDOW_W      = 1100.f;
+static const float WINDOW_W      = 1420.f;
 static const float WINDOW_H      = 700.f;
 
+// Decision region panel, right of the network
+static const float MAP_X         = 1110.f;
+static const float MAP_Y         = 100.f;
+static const float MAP_SIZE      = 280.f;
+static const unsigned MAP_PIXELS = 256;       // 65536 grid points per full pass
+static const std::size_t MAP_POINTS_PER_FRAME = 8192;  // roughly 1.5 ms of inference per frame
+
 // ─── Draw a clock-dial node ──────────────────────────────────────────────────
 // activation in [0,1] maps hand angle from -135deg to +135deg
 static void drawDialNode(sf::RenderWindow& window, sf::Vector2f pos, float activation, sf::Color rimColor)
@@ -87,7 +99,7 @@ struct Button {
 };
 
 // ─── Main visualizer ─────────────────────────────────────────────────────────
-void run_visualization(NeuralNetwork& nn, const std::vector<std::vector<Record>>& data)
+void run_visualization(NeuralNetwork& nn, const DataSplit& data)
 {
     sf::RenderWindow window(sf::VideoMode({(unsigned)WINDOW_W, (unsigned)WINDOW_H}),
                             "Neural Network Visualizer");
@@ -123,13 +135,28 @@ void run_visualization(NeuralNetwork& nn, const std::vector<std::vector<Record>>
     Button testBtn ({30.f,  90.f}, {120.f, 44.f}, "TEST",   font);
     testBtn.enabled = false;
 
+    // Cycle the inputs on the axes of the decision map
+    const char* featureNames[4] = {"Sepal L", "Sepal W", "Petal L", "Petal W"};
+    Button mapXBtn({MAP_X, MAP_Y + MAP_SIZE + 15.f}, {135.f, 36.f}, "", font);
+    Button mapYBtn({MAP_X + MAP_SIZE - 135.f, MAP_Y + MAP_SIZE + 15.f}, {135.f, 36.f}, "", font);
+
     // ── State ──
     bool  training     = false;
     bool  trained      = false;
     int   currentEpoch = 0;
     int   totalEpochs  = 1000;
-    int   epochStep    = 100;   // update visual every 100 epochs
     float lastCost     = 0.f;
+
+    // Training stops once the loss on a held out fifth of the training samples has not improved for 100 epochs,
+    // the weights of the best epoch are kept
+    ValidationSplit split = hold_out(data.training, 0.2);
+    TrainingOptions trainOptions;
+    trainOptions.max_epochs = totalEpochs;
+    trainOptions.learning_rate = 0.1;
+    trainOptions.patience = 100;
+    trainOptions.min_delta = 1e-6;
+    // Trains on its own thread while the loop below keeps drawing the latest snapshot it published
+    std::unique_ptr<BackgroundTrainer> trainer;
     std::string statusText = "Press TRAIN to start";
 
     // Activations (displayed on dials)
@@ -139,7 +166,7 @@ void run_visualization(NeuralNetwork& nn, const std::vector<std::vector<Record>>
 
     // Cache weights for connection drawing (flattened)
     // W1: 4x5,  W2: 5x3
-    auto getWeights = [&](const Matrix& m) {
+    auto getWeights = [&](const MatrixView& m) {
         std::vector<float> w;
         for (unsigned r = 0; r < m.get_num_rows(); ++r)
             for (unsigned c = 0; c < m.get_num_col(); ++c)
@@ -147,31 +174,87 @@ void run_visualization(NeuralNetwork& nn, const std::vector<std::vector<Record>>
         return w;
     };
 
-    std::vector<float> w1 = getWeights(nn.getW1());
-    std::vector<float> w2 = getWeights(nn.getW2());
-
-    // Helper: run one sample forward and pull activations
-    auto sampleActivations = [&](int sampleIdx) {
-        const auto& recs = data[0];
-        int idx = sampleIdx % (int)recs.size();
-        Matrix X(1, 4, 0.0);
-        X.set_val(0, 0, recs[idx].sepal_length);
-        X.set_val(0, 1, recs[idx].sepal_width);
-        X.set_val(0, 2, recs[idx].pedal_length);
-        X.set_val(0, 3, recs[idx].pedal_width);
+    std::vector<float> w1 = getWeights(nn.weights(0));
+    std::vector<float> w2 = getWeights(nn.weights(1));
 
-        act_input[0] = (float)recs[idx].sepal_length;
-        act_input[1] = (float)recs[idx].sepal_width;
-        act_input[2] = (float)recs[idx].pedal_length;
-        act_input[3] = (float)recs[idx].pedal_width;
+    // Activations for the TEST button come from the const inference path, so they never depend on training's caches
+    InferenceWorkspace displayWs;
 
-        nn.forward_propagation(X);
+    // Helper: show the weights and display sample of a snapshot published by the trainer
+    auto showSnapshot = [&](const TrainingSnapshot& snap) {
+        const LayerStack& layers = nn.get_layers();
+        w1 = getWeights(layers.weights(snap.parameters.data(), 0));
+        w2 = getWeights(layers.weights(snap.parameters.data(), 1));
 
+        if (snap.sample.empty())
+            return;
+        for (int i = 0; i < 4; ++i)
+            act_input[i] = (float)snap.sample[i];
         for (int i = 0; i < 5; ++i)
-            act_hidden[i] = (float)nn.getA1().get_val(0, i);
-        Matrix A2 = nn.forward_propagation(X);
+            act_hidden[i] = (float)snap.activations[0][i];
         for (int i = 0; i < 3; ++i)
-            act_output[i] = (float)A2.get_val(0, i);
+            act_output[i] = (float)snap.activations[1][i];
+    };
+
+    // ── Decision map ──
+    // Regions of the two selected inputs, the others at their mean, refreshed pass after pass from the newest weights
+    DecisionMap decisionMap(nn.get_layers(), data.data.view(), MAP_PIXELS, MAP_PIXELS);
+    decisionMap.set_axes(2, 3);
+    decisionMap.restart(nn.get_parameters().data());
+    bool mapStale = false;
+
+    sf::Texture mapTexture({MAP_PIXELS, MAP_PIXELS});
+    mapTexture.setSmooth(true);
+    mapTexture.update(decisionMap.pixels());
+    sf::Sprite mapSprite(mapTexture);
+    mapSprite.setPosition({MAP_X, MAP_Y});
+    mapSprite.setScale({MAP_SIZE / MAP_PIXELS, MAP_SIZE / MAP_PIXELS});
+
+    sf::RectangleShape mapFrame({MAP_SIZE, MAP_SIZE});
+    mapFrame.setPosition({MAP_X, MAP_Y});
+    mapFrame.setFillColor(sf::Color::Transparent);
+    mapFrame.setOutlineColor(OUTLINE_COLOR);
+    mapFrame.setOutlineThickness(2.f);
+
+    sf::Clock mapPassClock;
+    float mapPassMs = 0.f;
+
+    auto setAxisLabels = [&]() {
+        mapXBtn = Button({MAP_X, MAP_Y + MAP_SIZE + 15.f}, {135.f, 36.f}, std::string("X: ") + featureNames[decisionMap.get_feature_x()], font);
+        mapYBtn = Button({MAP_X + MAP_SIZE - 135.f, MAP_Y + MAP_SIZE + 15.f}, {135.f, 36.f}, std::string("Y: ") + featureNames[decisionMap.get_feature_y()], font);
+    };
+    setAxisLabels();
+
+    // Next input for one axis, skipping the one on the other axis
+    auto nextFeature = [](unsigned current, unsigned other) {
+        unsigned next = (current + 1) % 4;
+        return next == other ? (next + 1) % 4 : next;
+    };
+
+    // Samples drawn over the map in their class color
+    std::vector<sf::Color> classColors;
+    for (unsigned c = 0; c < data.data.num_classes(); ++c) {
+        std::uint8_t rgb[3];
+        DecisionMap::class_color(c, rgb);
+        classColors.push_back({rgb[0], rgb[1], rgb[2]});
+    }
+    auto drawMapSamples = [&]() {
+        const DatasetView all = data.data.view();
+        unsigned fx = decisionMap.get_feature_x(), fy = decisionMap.get_feature_y();
+        float xMin = (float)decisionMap.min_value(fx), xRange = (float)(decisionMap.max_value(fx) - decisionMap.min_value(fx));
+        float yMax = (float)decisionMap.max_value(fy), yRange = (float)(decisionMap.max_value(fy) - decisionMap.min_value(fy));
+
+        sf::CircleShape dot(2.5f);
+        dot.setOrigin({2.5f, 2.5f});
+        dot.setOutlineColor(WHITE);
+        dot.setOutlineThickness(1.f);
+        for (std::size_t i = 0; i < all.size(); ++i) {
+            const double* row = all.feature_row(i);
+            dot.setPosition({MAP_X + ((float)row[fx] - xMin) / xRange * MAP_SIZE,
+                             MAP_Y + (yMax - (float)row[fy]) / yRange * MAP_SIZE});
+            dot.setFillColor(classColors[all.label(i)]);
+            window.draw(dot);
+        }
     };
 
     // Status text widget
@@ -187,6 +270,14 @@ void run_visualization(NeuralNetwork& nn, const std::vector<std::vector<Record>>
     costLabel.setFillColor(TEXT_DIM);
     costLabel.setPosition({30.f, 200.f});
 
+    // Frame time of the render loop and epochs per second of the trainer, to check neither holds the other up
+    sf::Text paceLabel(font, "", 13);
+    paceLabel.setFillColor(TEXT_DIM);
+    paceLabel.setPosition({30.f, WINDOW_H - 30.f});
+    sf::Clock frameClock;
+    float frameMs = 0.f;
+    float epochsPerSecond = 0.f;
+
     // Layer labels
     auto makeLayerLabel = [&](const std::string& t, float x) {
         sf::Text lbl(font, t, 14);
@@ -199,6 +290,7 @@ void run_visualization(NeuralNetwork& nn, const std::vector<std::vector<Record>>
     auto lblInput  = makeLayerLabel("Input (4)",   x_input);
     auto lblHidden = makeLayerLabel("Hidden (5)",  x_hidden);
     auto lblOutput = makeLayerLabel("Output (3)",  x_output);
+    auto lblMap    = makeLayerLabel("Decision regions", MAP_X + MAP_SIZE / 2.f);
 
     // Output class names
     const char* classNames[3] = {"Setosa", "Versicolor", "Virginica"};
@@ -257,41 +349,39 @@ void run_visualization(NeuralNetwork& nn, const std::vector<std::vector<Record>>
                 if (trainBtn.contains(mpos) && trainBtn.enabled) {
                     training     = true;
                     currentEpoch = 0;
+                    trainer = std::make_unique<BackgroundTrainer>(nn, split.training, split.validation, trainOptions, data.training);
                     trainBtn.enabled = false;
                     statusText = "Training...";
                 }
 
+                if (mapXBtn.contains(mpos)) {
+                    decisionMap.set_axes(nextFeature(decisionMap.get_feature_x(), decisionMap.get_feature_y()), decisionMap.get_feature_y());
+                    setAxisLabels();
+                    mapPassClock.restart();
+                }
+                if (mapYBtn.contains(mpos)) {
+                    decisionMap.set_axes(decisionMap.get_feature_x(), nextFeature(decisionMap.get_feature_y(), decisionMap.get_feature_x()));
+                    setAxisLabels();
+                    mapPassClock.restart();
+                }
+
                 if (testBtn.contains(mpos) && testBtn.enabled) {
                     // Run test and show result
                     int correct = 0;
-                    const auto& recs = data[1];
+                    const DatasetView& recs = data.testing;
                     for (int i = 0; i < (int)recs.size(); ++i) {
-                        Matrix X(1, 4, 0.0);
-                        X.set_val(0, 0, recs[i].sepal_length);
-                        X.set_val(0, 1, recs[i].sepal_width);
-                        X.set_val(0, 2, recs[i].pedal_length);
-                        X.set_val(0, 3, recs[i].pedal_width);
-                        Matrix A2 = nn.forward_propagation(X);
-
-                        int pred = 0, actual = 0;
-                        for (int j = 1; j < 3; ++j) {
-                            if (A2.get_val(0,j) > A2.get_val(0,pred)) pred = j;
-                            Matrix Y(1, 3, 0.0);
-                            Y.set_val(0, 0, recs[i].one_hot[0]);
-                            Y.set_val(0, 1, recs[i].one_hot[1]);
-                            Y.set_val(0, 2, recs[i].one_hot[2]);
-                            if (Y.get_val(0,j) > Y.get_val(0,actual)) actual = j;
-                        }
+                        MatrixView A2 = nn.predict_batch(recs.slice(i, 1).features(), displayWs);
+
+                        int pred = (int)argmax_row(A2, 0);
+                        int actual = (int)recs.label(i);
                         if (pred == actual) correct++;
 
                         // Show last sample activations
                         if (i == (int)recs.size() - 1) {
-                            act_input[0] = (float)recs[i].sepal_length;
-                            act_input[1] = (float)recs[i].sepal_width;
-                            act_input[2] = (float)recs[i].pedal_length;
-                            act_input[3] = (float)recs[i].pedal_width;
+                            for (int k = 0; k < 4; ++k)
+                                act_input[k] = (float)recs.feature_row(i)[k];
                             for (int k = 0; k < 5; ++k)
-                                act_hidden[k] = (float)nn.getA1().get_val(0, k);
+                                act_hidden[k] = (float)displayWs.activations(0).get_val(0, k);
                             for (int k = 0; k < 3; ++k)
                                 act_output[k] = (float)A2.get_val(0, k);
                         }
@@ -302,46 +392,46 @@ void run_visualization(NeuralNetwork& nn, const std::vector<std::vector<Record>>
             }
         }
 
-        // ── Training step ──
-        if (training && currentEpoch < totalEpochs) {
-            // Train epochStep epochs
-            const auto& recs = data[0];
-            double totalCost = 0.0;
-            for (int e = 0; e < epochStep && currentEpoch < totalEpochs; ++e, ++currentEpoch) {
-                for (int i = 0; i < (int)recs.size(); ++i) {
-                    Matrix X(1, 4, 0.0);
-                    X.set_val(0, 0, recs[i].sepal_length);
-                    X.set_val(0, 1, recs[i].sepal_width);
-                    X.set_val(0, 2, recs[i].pedal_length);
-                    X.set_val(0, 3, recs[i].pedal_width);
-
-                    Matrix Y(1, 3, 0.0);
-                    Y.set_val(0, 0, recs[i].one_hot[0]);
-                    Y.set_val(0, 1, recs[i].one_hot[1]);
-                    Y.set_val(0, 2, recs[i].one_hot[2]);
-
-                    Matrix A2 = nn.forward_propagation(X);
-                    totalCost += mean_squared_error(A2, Y);
-                    GradientStruct g = nn.back_propagation(X, Y);
-                    nn.update_weights(g, 0.1);
+        // ── Training progress ──
+        // Never waits on the trainer, a frame without a new snapshot just draws the previous one again
+        if (training && trainer && trainer->refresh()) {
+            const TrainingSnapshot& snap = trainer->snapshot();
+            currentEpoch = (int)snap.report.epochs_run;
+            lastCost = (float)snap.report.training_cost;
+            epochsPerSecond = (float)snap.epochs_per_second;
+            showSnapshot(snap);
+            mapStale = true;
+
+            if (snap.finished) {
+                // The worker is done with the network, so it is safe to use from here on
+                training = false;
+                epochsPerSecond = 0.f;
+                try {
+                    trainer->wait();
+                    trained  = true;
+                    testBtn.enabled  = true;
+                    trainBtn.enabled = false;
+                    statusText = "Training complete! (" + std::string(stop_reason_name(snap.result.reason))
+                               + ", best epoch " + std::to_string(snap.result.best_epoch + 1) + ")";
+                } catch (const std::exception& e) {
+                    // Whatever training threw ends up here, TRAIN stays available to try again
+                    trainBtn.enabled = true;
+                    statusText = std::string("Training failed: ") + e.what();
                 }
             }
-            lastCost = (float)(totalCost / (epochStep * recs.size()));
-
-            // Update weight cache
-            w1 = getWeights(nn.getW1());
-            w2 = getWeights(nn.getW2());
-
-            // Update activations from sample 0
-            sampleActivations(currentEpoch);
+        }
 
-            if (currentEpoch >= totalEpochs) {
-                training = false;
-                trained  = true;
-                testBtn.enabled  = true;
-                trainBtn.enabled = false;
-                statusText = "Training complete!";
-            }
+        // ── Decision map refresh ──
+        // A new pass starts once the current one is done and newer weights came in, each frame evaluates a slice of it
+        if (mapStale && decisionMap.complete()) {
+            decisionMap.restart(training ? trainer->snapshot().parameters.data() : nn.get_parameters().data());
+            mapStale = false;
+            mapPassClock.restart();
+        }
+        if (decisionMap.advance(MAP_POINTS_PER_FRAME)) {
+            mapTexture.update(decisionMap.pixels());
+            if (decisionMap.complete())
+                mapPassMs = mapPassClock.getElapsedTime().asSeconds() * 1000.f;
         }
 
         // ── Update labels ──
@@ -349,6 +439,14 @@ void run_visualization(NeuralNetwork& nn, const std::vector<std::vector<Record>>
         epochLabel.setString(training || trained ? "Epoch: " + std::to_string(currentEpoch) + "/" + std::to_string(totalEpochs) : "");
         costLabel.setString(lastCost > 0.f ? "Cost: " + std::to_string(lastCost).substr(0, 8) : "");
 
+        // Smoothed over roughly the last 20 frames
+        float elapsedMs = frameClock.restart().asSeconds() * 1000.f;
+        frameMs = frameMs == 0.f ? elapsedMs : frameMs + (elapsedMs - frameMs) * 0.05f;
+        char pace[128];
+        std::snprintf(pace, sizeof(pace), "Frame: %.1f ms (%.0f fps)   Training: %.0f epochs/s   Decision map: %.0f ms per pass",
+                      frameMs, frameMs > 0.f ? 1000.f / frameMs : 0.f, epochsPerSecond, mapPassMs);
+        paceLabel.setString(pace);
+
         // ── Draw ──
         window.clear(BG_COLOR);
 
@@ -381,6 +479,14 @@ void run_visualization(NeuralNetwork& nn, const std::vector<std::vector<Record>>
             window.draw(clbl);
         }
 
+        // Decision map with the samples on top
+        window.draw(mapSprite);
+        window.draw(mapFrame);
+        drawMapSamples();
+        window.draw(lblMap);
+        mapXBtn.draw(window);
+        mapYBtn.draw(window);
+
         // Layer labels
         window.draw(lblInput);
         window.draw(lblHidden);
@@ -394,6 +500,7 @@ void run_visualization(NeuralNetwork& nn, const std::vector<std::vector<Record>>
         window.draw(statusLabel);
         window.draw(epochLabel);
         window.draw(costLabel);
+        window.draw(paceLabel);
 
         window.display();
     }